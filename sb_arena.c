@@ -0,0 +1,260 @@
+/* sb_arena.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Shared slab memory for plugin instances (see sb_arena.h).
+ *
+ * There are two levels.  The process-wide pool owns the slabs: 2 MB blocks
+ * from mmap() (huge pages if possible), carved into page-sized chunks with a
+ * first-fit free list.  Each instance's arena takes chunks from the pool as
+ * it needs them and bumps a pointer through the newest one; releasing the
+ * arena hands its chunks back to the pool, where neighbouring free chunks are
+ * merged again.  Requests too big for a slab get a mapping of their own,
+ * which is unmapped when the arena is released.
+ *
+ * The free list lives in the free chunks themselves, so the pool needs no
+ * memory of its own.  Slabs are never unmapped; once a session has needed
+ * that much memory, it is likely to need it again.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sb_arena.h"
+
+#define SLAB_SIZE  ((size_t)2 << 20)   /* also the usual huge page size */
+#define CHUNK_GRAIN ((size_t)4096)
+#define MIN_CHUNK  ((size_t)16 << 10)
+
+/* The header at the start of every chunk an arena owns.  It is padded to
+ * SB_ARENA_ALIGN so the first allocation after it is aligned too. */
+struct sb_arena_chunk {
+	sb_arena_chunk * next;
+	size_t size;                 /* including this header */
+	int dedicated;               /* a mapping of its own, not from a slab */
+};
+
+#define HEADER_SIZE \
+	((sizeof(sb_arena_chunk) + SB_ARENA_ALIGN - 1) & ~(size_t)(SB_ARENA_ALIGN - 1))
+
+/* A free chunk in the pool, kept in address order. */
+struct free_chunk {
+	struct free_chunk * next;
+	size_t size;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct free_chunk * free_list = NULL;
+static int use_mlock = -1;           /* -1 until SB_MLOCK has been read */
+
+static size_t round_up(size_t n, size_t to)
+{
+	return (n + to - 1) & ~(to - 1);
+}
+
+/*****************************************************************************
+ * Maps 'size' bytes (a multiple of SLAB_SIZE) of zeroed memory, in huge pages
+ * if we can get them.  Returns NULL on failure.
+ *****************************************************************************/
+static void * map_memory(size_t size)
+{
+	unsigned char * p;
+	uintptr_t aligned;
+
+	if (use_mlock < 0) {
+		const char * env = getenv("SB_MLOCK");
+		use_mlock = env && *env && strcmp(env, "0") != 0;
+	}
+
+#ifdef MAP_HUGETLB
+	/* explicit huge pages only work if the admin has reserved some */
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+		goto mapped;
+#endif
+
+	/* otherwise map a bit extra so the slab can start on a huge page
+	 * boundary, and ask for transparent huge pages */
+	p = mmap(NULL, size + SLAB_SIZE, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	aligned = round_up((uintptr_t)p, SLAB_SIZE);
+	if (aligned > (uintptr_t)p)
+		munmap(p, aligned - (uintptr_t)p);
+	munmap((unsigned char *)aligned + size,
+	       (uintptr_t)p + SLAB_SIZE - aligned);
+	p = (unsigned char *)aligned;
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+
+#ifdef MAP_HUGETLB
+mapped:
+#endif
+	if (use_mlock)
+		mlock(p, size);
+	return p;
+}
+
+/*****************************************************************************
+ * Puts a chunk on the pool's free list, merging it with the chunks on either
+ * side if they are free too.  The caller holds pool_lock.
+ *****************************************************************************/
+static void pool_put(void * memory, size_t size)
+{
+	struct free_chunk * chunk = memory;
+	struct free_chunk ** link = &free_list;
+	struct free_chunk * prev = NULL;
+
+	while (*link && (void *)*link < memory) {
+		prev = *link;
+		link = &(*link)->next;
+	}
+
+	chunk->size = size;
+	chunk->next = *link;
+	*link = chunk;
+
+	if (chunk->next
+	    && (unsigned char *)chunk + chunk->size
+	       == (unsigned char *)chunk->next) {
+		chunk->size += chunk->next->size;
+		chunk->next = chunk->next->next;
+	}
+	if (prev && (unsigned char *)prev + prev->size
+	            == (unsigned char *)chunk) {
+		prev->size += chunk->size;
+		prev->next = chunk->next;
+	}
+}
+
+/*****************************************************************************
+ * Takes a chunk of 'size' bytes (a multiple of CHUNK_GRAIN) from the pool,
+ * adding a new slab if none of the free chunks is big enough.  The caller
+ * holds pool_lock.  Returns NULL on failure.
+ *****************************************************************************/
+static void * pool_get(size_t size)
+{
+	struct free_chunk ** link;
+
+	for (;;) {
+		for (link = &free_list; *link; link = &(*link)->next) {
+			struct free_chunk * chunk = *link;
+
+			if (chunk->size < size)
+				continue;
+			if (chunk->size == size) {
+				*link = chunk->next;
+			}
+			else {
+				/* take the front, leave the rest on the list */
+				struct free_chunk * rest = (struct free_chunk *)
+				                           ((unsigned char *)chunk + size);
+				rest->size = chunk->size - size;
+				rest->next = chunk->next;
+				*link = rest;
+			}
+			return chunk;
+		}
+
+		{
+			void * slab = map_memory(SLAB_SIZE);
+
+			if (!slab)
+				return NULL;
+			pool_put(slab, SLAB_SIZE);
+		}
+	}
+}
+
+/*****************************************************************************
+ * Gets a new chunk with room for at least 'size' bytes after its header, and
+ * makes it the arena's newest chunk.  Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int add_chunk(sb_arena * arena, size_t size)
+{
+	sb_arena_chunk * chunk;
+	size_t chunk_size = round_up(HEADER_SIZE + size, CHUNK_GRAIN);
+	int dedicated = 0;
+
+	if (chunk_size < MIN_CHUNK)
+		chunk_size = MIN_CHUNK;
+
+	if (chunk_size > SLAB_SIZE / 2) {
+		/* too big to share a slab with anything; give it its own */
+		chunk_size = round_up(chunk_size, SLAB_SIZE);
+		pthread_mutex_lock(&pool_lock);
+		chunk = map_memory(chunk_size);
+		pthread_mutex_unlock(&pool_lock);
+		dedicated = 1;
+	}
+	else {
+		pthread_mutex_lock(&pool_lock);
+		chunk = pool_get(chunk_size);
+		pthread_mutex_unlock(&pool_lock);
+	}
+	if (!chunk)
+		return -1;
+
+	chunk->next = arena->chunks;
+	chunk->size = chunk_size;
+	chunk->dedicated = dedicated;
+	arena->chunks = chunk;
+	arena->next = (unsigned char *)chunk + HEADER_SIZE;
+	arena->end = (unsigned char *)chunk + chunk_size;
+	return 0;
+}
+
+void sb_arena_init(sb_arena * arena)
+{
+	arena->chunks = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+}
+
+void * sb_arena_alloc(sb_arena * arena, size_t size)
+{
+	void * p;
+
+	size = round_up(size ? size : 1, SB_ARENA_ALIGN);
+	if (!arena->next || (size_t)(arena->end - arena->next) < size)
+		if (add_chunk(arena, size) != 0)
+			return NULL;
+
+	p = arena->next;
+	arena->next += size;
+
+	/* chunks coming back from another instance still hold its old data;
+	 * zeroing also touches every page now instead of in run() */
+	memset(p, 0, size);
+	return p;
+}
+
+void sb_arena_release(sb_arena * arena)
+{
+	sb_arena_chunk * chunk = arena->chunks;
+
+	pthread_mutex_lock(&pool_lock);
+	while (chunk) {
+		sb_arena_chunk * next = chunk->next;
+
+		if (chunk->dedicated)
+			munmap(chunk, chunk->size);
+		else
+			pool_put(chunk, chunk->size);
+		chunk = next;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	sb_arena_init(arena);
+}
@@ -0,0 +1,65 @@
+/* sb_arena.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Memory for delay lines and scratch buffers, shared by every StudioBlood
+ * instance in the process.
+ *
+ * Instead of each instance calling malloc() for each of its buffers (and
+ * scattering them all over the heap), the buffers come out of big slabs that
+ * all the instances share.  The slabs are backed by huge pages when the
+ * system has them, so a session with hundreds of instances isn't constantly
+ * missing the TLB.  Each instance has an sb_arena of its own:
+ *
+ *     instantiate:  sb_arena_init(&plugin->arena);
+ *                   plugin->delay = sb_arena_alloc(&plugin->arena, bytes);
+ *     cleanup:      sb_arena_release(&plugin->arena);
+ *
+ * Everything an instance got from its arena is given back at once by
+ * sb_arena_release(); there is no freeing of single buffers.  The memory
+ * handed out is zeroed and aligned to 64 bytes (a cache line), and has
+ * already been touched, so run() never takes a page fault on it the first
+ * time through.
+ *
+ * If the SB_MLOCK environment variable is set to anything but "0", the slabs
+ * are also mlock()ed so they can never be paged out from under a real-time
+ * thread (this needs a big enough RLIMIT_MEMLOCK; if mlock() fails the
+ * memory is used anyway).
+ *
+ * sb_arena_init(), sb_arena_alloc() and sb_arena_release() take a lock and
+ * may call mmap(), so they belong in instantiate()/activate() and cleanup(),
+ * never in run().
+ */
+
+#ifndef SB_ARENA_H
+#define SB_ARENA_H
+
+#include <stddef.h>
+
+/* Everything sb_arena_alloc() returns is aligned to this. */
+#define SB_ARENA_ALIGN 64
+
+typedef struct sb_arena_chunk sb_arena_chunk;
+
+typedef struct {
+	sb_arena_chunk * chunks;     /* all the chunks this arena owns */
+	unsigned char * next;        /* next free byte in the newest chunk */
+	unsigned char * end;         /* end of the newest chunk */
+} sb_arena;
+
+/* Sets up an empty arena. */
+void sb_arena_init(sb_arena * arena);
+
+/* Returns 'size' zeroed bytes aligned to SB_ARENA_ALIGN, or NULL if there is
+ * no memory left. */
+void * sb_arena_alloc(sb_arena * arena, size_t size);
+
+/* Gives back everything the arena handed out, and leaves it empty. */
+void sb_arena_release(sb_arena * arena);
+
+#endif
@@ -0,0 +1,614 @@
+/* sb_bench.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Offline benchmark harness for the StudioBlood plugins.
+ *
+ * This is a tiny LADSPA "host".  It dlopen()s each shared object given on the
+ * command line, asks ladspa_descriptor() for every plugin inside of it, and
+ * then for each sample rate and block size:
+ *
+ *   instantiate -> connect every port -> activate -> run() over and over
+ *
+ * while timing how long the run() calls take.  Plugins that have run_adding()
+ * are timed with that too.  The result is printed as one tab-separated line
+ * per (plugin, run or run_adding, sample rate, block size) so that builds
+ * (for instance with and without the -O3 flags in Makefile_old) can be
+ * compared with diff or a spreadsheet.  A comment line before them says
+ * which instruction set the shared kernels picked (see sb_isa.h).
+ *
+ * Usage: sb_bench [-R] [-k] [-r rate,rate,...] [-b min:max] [-s seconds]
+ *                 plugin.so ...
+ *
+ *   -R  real-time check: fail if run() or run_adding() ever allocates or
+ *       frees memory (and warn about plugins that aren't marked
+ *       LADSPA_PROPERTY_HARD_RT_CAPABLE)
+ *   -k  first time the shared sb_mix.h kernels at each of the block sizes
+ *       that sb_block.h gives a copy of their own, both through the generic
+ *       path and the fixed-size one, and print how much faster the fixed
+ *       one is (the plugin arguments are optional with -k, and -s doesn't
+ *       apply: each line of output takes about two seconds)
+ *   -r  sample rates to instantiate at (default 44100,48000,96000)
+ *   -b  smallest and largest block size, stepping by powers of two
+ *       (default 64:65536)
+ *   -s  seconds of audio to push through run() per measurement (default 10)
+ *
+ * For -R, sb_bench replaces malloc() and friends with versions that count
+ * the calls made while a plugin is running.  It has to be linked with
+ * -rdynamic so that the plugins it dlopen()s use them instead of libc's.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ladspa.h"
+#include "sb_block.h"
+#include "sb_host.h"
+#include "sb_isa.h"
+#include "sb_mix.h"
+
+#define MAX_RATES 16
+
+/* The test signal is regenerated for every measurement from this seed, so
+ * that every build sees exactly the same input. */
+#define NOISE_SEED 0x5B5B5B5BUL
+
+/* Whatever the host tells us to run with. */
+static unsigned long rates[MAX_RATES] = { 44100, 48000, 96000 };
+static int rate_count = 3;
+static unsigned long min_block = 64;
+static unsigned long max_block = 65536;
+static double seconds = 10.0;
+static int rt_check = 0;
+static int kernel_check = 0;
+
+/*****************************************************************************
+ * ALLOCATION COUNTING (for -R)
+ *
+ * While 'in_run' is set, every call into the allocator is counted.  The real
+ * work is passed on to glibc's own entry points.
+ *****************************************************************************/
+#ifdef __GLIBC__
+#define HAVE_ALLOCATION_COUNTING 1
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * p, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void * p);
+
+static volatile int in_run = 0;
+static volatile unsigned long allocations = 0;
+
+void * malloc(size_t size)
+{
+	if (in_run)
+		++allocations;
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+	if (in_run)
+		++allocations;
+	return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+	if (in_run)
+		++allocations;
+	return __libc_realloc(p, size);
+}
+
+void free(void * p)
+{
+	if (in_run && p)
+		++allocations;
+	__libc_free(p);
+}
+
+void * memalign(size_t alignment, size_t size)
+{
+	if (in_run)
+		++allocations;
+	return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void ** p, size_t alignment, size_t size)
+{
+	void * memory;
+
+	if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+	memory = memalign(alignment, size);
+	if (!memory)
+		return ENOMEM;
+	*p = memory;
+	return 0;
+}
+#else
+#define HAVE_ALLOCATION_COUNTING 0
+
+static int in_run = 0;
+static unsigned long allocations = 0;
+#endif
+
+/*****************************************************************************
+ * Returns the current time of the monotonic clock in nanoseconds.
+ *****************************************************************************/
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/*****************************************************************************
+ * Fills the given buffer with white noise between -1.0 and 1.0.  A plain
+ * linear congruential generator is plenty for a test signal, and it keeps
+ * the harness independent of xorgens (which the plugins themselves use).
+ *****************************************************************************/
+static void fill_noise(LADSPA_Data * buffer, unsigned long count,
+                       unsigned long * state)
+{
+	unsigned long i;
+
+	for (i = 0; i < count; ++i) {
+		*state = *state * 1103515245UL + 12345UL;
+		buffer[i] = (LADSPA_Data)((*state >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+	}
+}
+
+/*****************************************************************************
+ * Runs one measurement: a fresh instance of the plugin at the given sample
+ * rate is fed 'seconds' worth of noise in blocks of 'block' samples, through
+ * run_adding() if 'adding' is set and run() if not.
+ *
+ * Returns the average number of nanoseconds spent per sample, or a negative
+ * number if the plugin could not be set up.
+ *****************************************************************************/
+static double bench_one(const LADSPA_Descriptor * d, unsigned long rate,
+                        unsigned long block, int adding)
+{
+	void (*run)(LADSPA_Handle, unsigned long) = adding ? d->run_adding
+	                                                   : d->run;
+	LADSPA_Handle instance;
+	LADSPA_Data ** buffers;
+	LADSPA_Data * controls;
+	unsigned long port;
+	unsigned long calls;
+	unsigned long i;
+	unsigned long noise = NOISE_SEED;
+	double start;
+	double elapsed;
+
+	buffers = calloc(d->PortCount, sizeof(LADSPA_Data *));
+	controls = calloc(d->PortCount, sizeof(LADSPA_Data));
+	if (!buffers || !controls) {
+		free(buffers);
+		free(controls);
+		return -1.0;
+	}
+
+	instance = d->instantiate(d, rate);
+	if (!instance) {
+		free(buffers);
+		free(controls);
+		return -1.0;
+	}
+
+	/* audio ports get a buffer of their own (never shared, so plugins that
+	 * are LADSPA_PROPERTY_INPLACE_BROKEN are timed fairly); control ports
+	 * point into the 'controls' array */
+	for (port = 0; port < d->PortCount; ++port) {
+		LADSPA_PortDescriptor pd = d->PortDescriptors[port];
+
+		if (LADSPA_IS_PORT_AUDIO(pd)) {
+			buffers[port] = malloc(block * sizeof(LADSPA_Data));
+			if (!buffers[port]) {
+				elapsed = -1.0;
+				goto done;
+			}
+			if (LADSPA_IS_PORT_INPUT(pd))
+				fill_noise(buffers[port], block, &noise);
+			else
+				memset(buffers[port], 0, block * sizeof(LADSPA_Data));
+			d->connect_port(instance, port, buffers[port]);
+		}
+		else {
+			if (LADSPA_IS_PORT_INPUT(pd))
+				controls[port] = sb_host_default_control(
+				                 &d->PortRangeHints[port], rate);
+			d->connect_port(instance, port, &controls[port]);
+		}
+	}
+
+	if (d->activate)
+		d->activate(instance);
+	if (adding && d->set_run_adding_gain)
+		d->set_run_adding_gain(instance, 1.0f);
+
+	/* enough calls to cover the requested amount of audio, but never less
+	 * than a handful so tiny blocks at low rates still get averaged */
+	calls = (unsigned long)(seconds * (double)rate / (double)block);
+	if (calls < 16)
+		calls = 16;
+
+	/* one untimed call to warm up caches and let the plugin settle (it
+	 * still isn't allowed to allocate, though) */
+	allocations = 0;
+	in_run = 1;
+	run(instance, block);
+
+	start = now_ns();
+	for (i = 0; i < calls; ++i)
+		run(instance, block);
+	elapsed = (now_ns() - start) / ((double)calls * (double)block);
+	in_run = 0;
+
+	if (d->deactivate)
+		d->deactivate(instance);
+
+done:
+	d->cleanup(instance);
+	for (port = 0; port < d->PortCount; ++port)
+		free(buffers[port]);
+	free(buffers);
+	free(controls);
+
+	return elapsed;
+}
+
+/*****************************************************************************
+ * KERNEL COMPARISON (for -k)
+ *
+ * Each kernel is wrapped twice: once taking the block size as it comes, and
+ * once through SB_BLOCK_DISPATCH the way a plugin's run() would.  Both are
+ * kept out of line (and called through a pointer) so that the compiler can't
+ * see the block size at the call site and the dispatch is paid for.
+ *****************************************************************************/
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+typedef void (*kernel_function)(LADSPA_Data * out, const LADSPA_Data * src,
+                                unsigned long count);
+
+static SB_ALWAYS_INLINE void add_block(LADSPA_Data * out,
+                                       const LADSPA_Data * src,
+                                       unsigned long count)
+{
+	sb_store_block(out, src, count, 0.5f, SB_ADD);
+}
+
+static SB_ALWAYS_INLINE void add_fill(LADSPA_Data * out,
+                                      const LADSPA_Data * src,
+                                      unsigned long count)
+{
+	sb_store_fill(out, src[0], count, 0.5f, SB_ADD);
+}
+
+static SB_ALWAYS_INLINE void replace_fill(LADSPA_Data * out,
+                                          const LADSPA_Data * src,
+                                          unsigned long count)
+{
+	sb_store_fill(out, src[0], count, 1.0f, SB_REPLACE);
+}
+
+#define KERNEL_WRAPPERS(name) \
+	static NOINLINE void name##_generic(LADSPA_Data * out, \
+	                                    const LADSPA_Data * src, \
+	                                    unsigned long count) \
+	{ \
+		name(out, src, count); \
+	} \
+	static NOINLINE void name##_fixed(LADSPA_Data * out, \
+	                                  const LADSPA_Data * src, \
+	                                  unsigned long count) \
+	{ \
+		SB_BLOCK_DISPATCH(count, name##_CALL); \
+	}
+
+#define add_block_CALL(n)    add_block(out, src, (n))
+#define add_fill_CALL(n)     add_fill(out, src, (n))
+#define replace_fill_CALL(n) replace_fill(out, src, (n))
+
+KERNEL_WRAPPERS(add_block)
+KERNEL_WRAPPERS(add_fill)
+KERNEL_WRAPPERS(replace_fill)
+
+static const struct {
+	const char * name;
+	kernel_function versions[2];         /* generic, fixed */
+} kernels[] = {
+	{ "sb_store_block/add", { add_block_generic, add_block_fixed } },
+	{ "sb_store_fill/add", { add_fill_generic, add_fill_fixed } },
+	{ "sb_store_fill/replace", { replace_fill_generic, replace_fill_fixed } }
+};
+
+#define FIXED_BLOCK_ENTRY(unused, n) n,
+
+static const unsigned long fixed_blocks[] = {
+	SB_FIXED_BLOCKS(FIXED_BLOCK_ENTRY, )
+};
+
+/*****************************************************************************
+ * Calls 'kernel' 'calls' times on blocks of 'block' samples, and returns the
+ * nanoseconds it took per sample.
+ *****************************************************************************/
+static double kernel_round(kernel_function kernel, LADSPA_Data * out,
+                           const LADSPA_Data * src, unsigned long block,
+                           unsigned long calls)
+{
+	double start = now_ns();
+	unsigned long i;
+
+	for (i = 0; i < calls; ++i)
+		kernel(out, src, block);
+	return (now_ns() - start) / ((double)calls * (double)block);
+}
+
+/*****************************************************************************
+ * Returns how many calls of 'kernel' on blocks of 'block' samples take at
+ * least KERNEL_ROUND_NS, by doubling the count until they do.
+ *****************************************************************************/
+#define KERNEL_ROUNDS   9
+#define KERNEL_ROUND_NS 100e6
+
+static unsigned long kernel_calls(kernel_function kernel, LADSPA_Data * out,
+                                  const LADSPA_Data * src, unsigned long block)
+{
+	unsigned long calls = 16;
+
+	while (kernel_round(kernel, out, src, block, calls) * (double)calls
+	       * (double)block < KERNEL_ROUND_NS)
+		calls *= 2;
+	return calls;
+}
+
+/*****************************************************************************
+ * Times the generic and fixed-size versions of a kernel on blocks of 'block'
+ * samples, in nanoseconds per sample: the best of KERNEL_ROUNDS rounds of at
+ * least KERNEL_ROUND_NS each.  A call only takes tens of nanoseconds, so
+ * short rounds are at the mercy of the clock's resolution, the CPU changing
+ * speed and the odd interrupt, and the rounds of the two versions take turns
+ * so that they both see the machine in the same state.
+ *****************************************************************************/
+static void time_kernel(const kernel_function * versions, LADSPA_Data * out,
+                        const LADSPA_Data * src, unsigned long block,
+                        double * best)
+{
+	unsigned long calls[2];
+	int round;
+	int v;
+
+	memset(out, 0, block * sizeof(LADSPA_Data));
+	for (v = 0; v < 2; ++v)
+		calls[v] = kernel_calls(versions[v], out, src, block);
+
+	for (round = 0; round < KERNEL_ROUNDS; ++round) {
+		for (v = 0; v < 2; ++v) {
+			double ns = kernel_round(versions[v], out, src, block,
+			                         calls[v]);
+
+			if (round == 0 || ns < best[v])
+				best[v] = ns;
+		}
+	}
+}
+
+/*****************************************************************************
+ * Prints the generic and fixed-size timings of every kernel.  Returns 0, or
+ * -1 if the buffers could not be allocated.
+ *****************************************************************************/
+static int bench_kernels(void)
+{
+	unsigned long largest = 0;
+	unsigned long noise = NOISE_SEED;
+	LADSPA_Data * out;
+	LADSPA_Data * src;
+	size_t k;
+	size_t b;
+
+	for (b = 0; b < sizeof(fixed_blocks) / sizeof(fixed_blocks[0]); ++b)
+		if (fixed_blocks[b] > largest)
+			largest = fixed_blocks[b];
+
+	out = malloc(largest * sizeof(LADSPA_Data));
+	src = malloc(largest * sizeof(LADSPA_Data));
+	if (!out || !src) {
+		free(out);
+		free(src);
+		fprintf(stderr, "sb_bench: out of memory\n");
+		return -1;
+	}
+	fill_noise(src, largest, &noise);
+
+	/* one throwaway measurement, so that the first real one isn't paying
+	 * for the CPU clocking up */
+	kernel_calls(kernels[0].versions[0], out, src, largest);
+
+	printf("# kernel\tblock\tgeneric ns/sample\tfixed ns/sample\tgain\n");
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+		for (b = 0; b < sizeof(fixed_blocks) / sizeof(fixed_blocks[0]); ++b) {
+			double best[2];
+
+			time_kernel(kernels[k].versions, out, src, fixed_blocks[b],
+			            best);
+			printf("%s\t%lu\t%.4f\t%.4f\t%+.1f%%\n", kernels[k].name,
+			       fixed_blocks[b], best[0], best[1],
+			       (best[0] / best[1] - 1.0) * 100.0);
+			fflush(stdout);
+		}
+	}
+
+	free(out);
+	free(src);
+	return 0;
+}
+
+/*****************************************************************************
+ * Benchmarks every plugin found in one shared object.
+ *
+ * Returns 0 on success, or -1 if the file could not be loaded or (with -R)
+ * a plugin allocated memory while running.
+ *****************************************************************************/
+static int bench_library(const char * path)
+{
+	void * library;
+	LADSPA_Descriptor_Function descriptor_function;
+	const LADSPA_Descriptor * d;
+	unsigned long index;
+	unsigned long block;
+	int adding;
+	int failed = 0;
+	int r;
+
+	library = sb_host_open(path, &descriptor_function);
+	if (!library) {
+		fprintf(stderr, "sb_bench: %s\n", sb_host_error());
+		return -1;
+	}
+
+	for (index = 0; (d = descriptor_function(index)) != NULL; ++index) {
+		if (rt_check && !LADSPA_IS_HARD_RT_CAPABLE(d->Properties))
+			fprintf(stderr, "sb_bench: warning: %s is not marked "
+			        "LADSPA_PROPERTY_HARD_RT_CAPABLE\n", d->Label);
+
+		for (adding = 0; adding <= (d->run_adding != NULL); ++adding) {
+			for (r = 0; r < rate_count; ++r) {
+				for (block = min_block; block <= max_block; block <<= 1) {
+					double ns = bench_one(d, rates[r], block, adding);
+
+					if (ns < 0.0) {
+						fprintf(stderr, "sb_bench: %s: could not run %s at "
+						        "%lu Hz\n", path, d->Label, rates[r]);
+						break;
+					}
+					if (rt_check && allocations) {
+						fprintf(stderr, "sb_bench: %s: %s() allocated or "
+						        "freed memory %lu times (%lu Hz, block %lu)"
+						        "\n", d->Label,
+						        adding ? "run_adding" : "run", allocations,
+						        rates[r], block);
+						failed = 1;
+					}
+					printf("%s\t%s\t%lu\t%s\t%lu\t%lu\t%.0f\t%.3f\n", path,
+					       d->Label, d->UniqueID,
+					       adding ? "run_adding" : "run", rates[r], block,
+					       1e9 / ns, ns);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+
+	dlclose(library);
+	return failed ? -1 : 0;
+}
+
+/*****************************************************************************
+ * Parses a comma separated list of sample rates into 'rates'.
+ *****************************************************************************/
+static int parse_rates(const char * arg)
+{
+	char * end;
+
+	rate_count = 0;
+	while (*arg && rate_count < MAX_RATES) {
+		errno = 0;
+		rates[rate_count] = strtoul(arg, &end, 10);
+		if (errno || end == arg || rates[rate_count] == 0)
+			return -1;
+		++rate_count;
+		if (*end == ',')
+			++end;
+		else if (*end)
+			return -1;
+		arg = end;
+	}
+	return rate_count > 0 ? 0 : -1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sb_bench [-R] [-k] [-r rate,rate,...] "
+	        "[-b min:max] [-s seconds] plugin.so ...\n");
+	exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+	int failures = 0;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-R") == 0) {
+			if (!HAVE_ALLOCATION_COUNTING) {
+				fprintf(stderr, "sb_bench: -R needs glibc\n");
+				return 2;
+			}
+			rt_check = 1;
+			continue;
+		}
+		if (strcmp(argv[i], "-k") == 0) {
+			kernel_check = 1;
+			continue;
+		}
+		if (i + 1 >= argc)
+			usage();
+		if (strcmp(argv[i], "-r") == 0) {
+			if (parse_rates(argv[++i]) != 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-b") == 0) {
+			if (sscanf(argv[++i], "%lu:%lu", &min_block, &max_block) != 2
+			    || min_block == 0 || min_block > max_block)
+				usage();
+		}
+		else if (strcmp(argv[i], "-s") == 0) {
+			seconds = atof(argv[++i]);
+			if (seconds <= 0.0)
+				usage();
+		}
+		else
+			usage();
+	}
+	if (i >= argc && !kernel_check)
+		usage();
+
+	if (kernel_check) {
+		if (bench_kernels() != 0)
+			++failures;
+		if (i >= argc)
+			return failures ? 1 : 0;
+	}
+
+	/* the plugins make the same choice as this build of sb_isa.c, as long
+	 * as they were configured the same way */
+	printf("# kernels: %s\n", sb_isa_name(sb_isa()));
+	printf("# plugin\tlabel\tid\tmode\trate\tblock\tsamples/sec\tns/sample\n");
+	for (; i < argc; ++i)
+		if (bench_library(argv[i]) != 0)
+			++failures;
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+/* sb_block.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Block size dispatch for run().
+ *
+ * Most hosts call run() with the same power-of-two block size every time.
+ * When the processing function is inlined with that size as a constant, the
+ * compiler knows every loop's trip count: it can unroll and vectorize without
+ * a remainder loop, and drop the checks for short blocks.  SB_BLOCK_DISPATCH
+ * makes one such copy for each size in SB_FIXED_BLOCKS and a generic copy for
+ * everything else:
+ *
+ *     static SB_ALWAYS_INLINE void process(Plugin * p, unsigned long count,
+ *                                          int adding)
+ *     {
+ *         ...
+ *     }
+ *
+ *     static void run_plugin(LADSPA_Handle h, unsigned long count)
+ *     {
+ *     #define PROCESS(n) process((Plugin *)h, (n), SB_REPLACE)
+ *         SB_BLOCK_DISPATCH(count, PROCESS);
+ *     #undef PROCESS
+ *     }
+ *
+ * This works together with the SB_REPLACE/SB_ADD trick in sb_mix.h (whose
+ * kernels are inline for the same reason), so run() and run_adding() each
+ * get one copy per block size.  Every extra size costs another copy of
+ * process() in the .so, so keep the list short.  'sb_bench -k' shows what
+ * the fixed sizes gain over the generic path for the shared kernels.
+ */
+
+#ifndef SB_BLOCK_H
+#define SB_BLOCK_H
+
+#if defined(__GNUC__)
+#define SB_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define SB_ALWAYS_INLINE inline
+#endif
+
+/* The block sizes that get a copy of their own: X(arg, size) for each. */
+#define SB_FIXED_BLOCKS(X, arg) X(arg, 128) X(arg, 256) X(arg, 512)
+
+#define SB_BLOCK_CASE_(CALL, n) case n: CALL(n); break;
+
+/* Calls CALL(n) with n a constant if 'count' is one of SB_FIXED_BLOCKS, and
+ * CALL(count) otherwise.  CALL is the name of a function-like macro. */
+#define SB_BLOCK_DISPATCH(count, CALL) \
+	do { \
+		switch (count) { \
+		SB_FIXED_BLOCKS(SB_BLOCK_CASE_, CALL) \
+		default: CALL(count); break; \
+		} \
+	} while (0)
+
+#endif
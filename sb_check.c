@@ -0,0 +1,792 @@
+/* sb_check.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Helper for the 'make check' scripts in tests/.  It does the few things the
+ * scripts can't do with sb_render and sb_bench alone:
+ *
+ *   sb_check noise output.wav frames channels rate seed
+ *       writes a 32-bit float WAV file of white noise between -1.0 and 1.0.
+ *       The same seed always gives the same file, on every machine.
+ *
+ *   sb_check labels plugin.so
+ *       prints the label and the number of audio inputs of every plugin in
+ *       the library, one per line.
+ *
+ *   sb_check compare expected.wav actual.wav tolerance
+ *       compares two 32-bit float WAV files, and fails if they differ in
+ *       length or channels, or if any sample is further than 'tolerance'
+ *       from the expected one.
+ *
+ *   sb_check reverse
+ *       checks the sb_reverse.h kernels that sb_isa() picks (set SB_ISA to
+ *       try the others) against a plain loop, for every length from 0 to
+ *       520 samples at aligned and odd offsets, and checks that they never
+ *       write past the samples they were given.
+ *
+ *   sb_check arena
+ *       has several threads allocate buffers of mixed sizes from sb_arena
+ *       (some big enough for a mapping of their own) and release them again
+ *       at random, and checks that every buffer is aligned, zeroed, and
+ *       doesn't overlap any other live one.
+ *
+ *   sb_check gate
+ *       checks sb_is_silent(), the sb_gate open/closing/closed sequence and
+ *       sb_denormals_off()/sb_denormals_restore() from sb_denormal.h.
+ *
+ *   sb_check control
+ *       checks the change detection and ramping of sb_control.h.
+ *
+ *   sb_check profile
+ *       feeds sb_profile made-up run() timings of 1 to 1000 ns per sample
+ *       and prints its report (to wherever SB_PROFILE says).  sb_check is
+ *       always built with SB_ENABLE_PROFILE, so that the profiling code is
+ *       compiled and tested even though the plugins normally leave it out.
+ *
+ * Exits with 0 on success, 1 if the check failed, and 2 on bad usage or
+ * unreadable files.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ladspa.h"
+#include "sb_arena.h"
+#include "sb_control.h"
+#include "sb_denormal.h"
+#include "sb_host.h"
+#include "sb_profile.h"
+#include "sb_reverse.h"
+
+/* A whole WAV file, read into memory (the files made by the tests are only a
+ * few seconds long). */
+struct wav {
+	float * samples;
+	unsigned long frames;
+	unsigned int channels;
+	unsigned long rate;
+};
+
+static unsigned int get_u16(const unsigned char * p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned long get_u32(const unsigned char * p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8)
+	       | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static void put_u16(unsigned char * p, unsigned int v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_u32(unsigned char * p, unsigned long v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************
+ * Reads a 32-bit float WAV file into 'wav'.  Returns 0 on success, -1 on
+ * failure.
+ *****************************************************************************/
+static int read_wav(const char * path, struct wav * wav)
+{
+	FILE * f = fopen(path, "rb");
+	unsigned char header[12];
+	unsigned char chunk[8];
+	unsigned int format = 0;
+	unsigned int bits = 0;
+
+	memset(wav, 0, sizeof(*wav));
+	if (!f) {
+		fprintf(stderr, "sb_check: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fread(header, 1, 12, f) != 12 || memcmp(header, "RIFF", 4) != 0
+	    || memcmp(header + 8, "WAVE", 4) != 0)
+		goto bad;
+
+	while (fread(chunk, 1, 8, f) == 8) {
+		unsigned long size = get_u32(chunk + 4);
+		unsigned long pad = size & 1;
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+			unsigned char body[40];
+			size_t want = size < sizeof(body) ? size : sizeof(body);
+
+			if (fread(body, 1, want, f) != want)
+				goto bad;
+			format = get_u16(body);
+			wav->channels = get_u16(body + 2);
+			wav->rate = get_u32(body + 4);
+			bits = get_u16(body + 14);
+			if (format == 0xFFFE && want >= 26)
+				format = get_u16(body + 24);
+			size -= want;
+		}
+		else if (memcmp(chunk, "data", 4) == 0) {
+			if (format != 3 || bits != 32 || wav->channels == 0)
+				goto bad;
+			wav->frames = size / (wav->channels * sizeof(float));
+			wav->samples = malloc((size_t)wav->frames * wav->channels
+			                      * sizeof(float) + 1);
+			if (!wav->samples
+			    || fread(wav->samples, sizeof(float),
+			             (size_t)wav->frames * wav->channels, f)
+			       != (size_t)wav->frames * wav->channels)
+				goto bad;
+			fclose(f);
+			return 0;
+		}
+		if (fseek(f, (long)(size + pad), SEEK_CUR) != 0)
+			goto bad;
+	}
+
+bad:
+	fprintf(stderr, "sb_check: %s: not a readable 32-bit float WAV file\n",
+	        path);
+	free(wav->samples);
+	wav->samples = NULL;
+	fclose(f);
+	return -1;
+}
+
+/*****************************************************************************
+ * sb_check noise: the same linear congruential generator as sb_bench, so
+ * the test signal doesn't depend on the C library.
+ *****************************************************************************/
+static int make_noise(const char * path, unsigned long frames,
+                      unsigned int channels, unsigned long rate,
+                      unsigned long seed)
+{
+	unsigned char h[44];
+	unsigned long bytes = frames * channels * sizeof(float);
+	unsigned long state = seed;
+	unsigned long i;
+	FILE * f;
+
+	memcpy(h, "RIFF", 4);
+	put_u32(h + 4, 36 + bytes);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_u32(h + 16, 16);
+	put_u16(h + 20, 3);
+	put_u16(h + 22, channels);
+	put_u32(h + 24, rate);
+	put_u32(h + 28, rate * channels * sizeof(float));
+	put_u16(h + 32, channels * sizeof(float));
+	put_u16(h + 34, 32);
+	memcpy(h + 36, "data", 4);
+	put_u32(h + 40, bytes);
+
+	f = fopen(path, "wb");
+	if (!f || fwrite(h, 1, sizeof(h), f) != sizeof(h)) {
+		fprintf(stderr, "sb_check: %s: %s\n", path, strerror(errno));
+		if (f)
+			fclose(f);
+		return 2;
+	}
+	for (i = 0; i < frames * channels; ++i) {
+		float sample;
+
+		state = (state * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+		sample = (float)((state >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+		fwrite(&sample, sizeof(sample), 1, f);
+	}
+	if (fclose(f) != 0) {
+		fprintf(stderr, "sb_check: %s: %s\n", path, strerror(errno));
+		return 2;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * sb_check labels
+ *****************************************************************************/
+static int list_labels(const char * path)
+{
+	LADSPA_Descriptor_Function function;
+	const LADSPA_Descriptor * d;
+	void * library = sb_host_open(path, &function);
+	unsigned long index;
+
+	if (!library) {
+		fprintf(stderr, "sb_check: %s\n", sb_host_error());
+		return 2;
+	}
+	for (index = 0; (d = function(index)) != NULL; ++index) {
+		unsigned long port;
+		unsigned int inputs = 0;
+
+		for (port = 0; port < d->PortCount; ++port)
+			if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[port])
+			    && LADSPA_IS_PORT_INPUT(d->PortDescriptors[port]))
+				++inputs;
+		printf("%s %u\n", d->Label, inputs);
+	}
+	dlclose(library);
+	return 0;
+}
+
+/*****************************************************************************
+ * sb_check compare
+ *****************************************************************************/
+static int compare(const char * expected_path, const char * actual_path,
+                   double tolerance)
+{
+	struct wav expected;
+	struct wav actual;
+	double worst = 0.0;
+	unsigned long worst_at = 0;
+	unsigned long i;
+	int result = 0;
+
+	if (read_wav(expected_path, &expected) != 0)
+		return 2;
+	if (read_wav(actual_path, &actual) != 0) {
+		free(expected.samples);
+		return 2;
+	}
+
+	if (expected.frames != actual.frames
+	    || expected.channels != actual.channels
+	    || expected.rate != actual.rate) {
+		fprintf(stderr, "sb_check: %s: %lu frames of %u channels at %lu Hz, "
+		        "expected %lu of %u at %lu Hz\n", actual_path, actual.frames,
+		        actual.channels, actual.rate, expected.frames,
+		        expected.channels, expected.rate);
+		result = 1;
+	}
+	else {
+		for (i = 0; i < expected.frames * expected.channels; ++i) {
+			double diff = fabs((double)expected.samples[i]
+			                   - (double)actual.samples[i]);
+
+			/* NaN never compares greater, so check for it on its own */
+			if (diff > worst || diff != diff) {
+				worst = diff;
+				worst_at = i;
+				if (diff != diff)
+					break;
+			}
+		}
+		if (worst > tolerance || worst != worst) {
+			fprintf(stderr, "sb_check: %s: frame %lu channel %lu is off by "
+			        "%g (tolerance %g)\n", actual_path,
+			        worst_at / expected.channels,
+			        worst_at % expected.channels, worst, tolerance);
+			result = 1;
+		}
+	}
+
+	free(expected.samples);
+	free(actual.samples);
+	return result;
+}
+
+/*****************************************************************************
+ * sb_check reverse: every buffer has REVERSE_GUARD samples of GUARD_VALUE on
+ * each side of the part the kernel is given, and anything but GUARD_VALUE
+ * there afterwards is a write out of bounds.
+ *****************************************************************************/
+#define REVERSE_MAX   520
+#define REVERSE_GUARD 32
+#define GUARD_VALUE   -12345.0f
+
+static int check_guards(const LADSPA_Data * buffer, unsigned long start,
+                        unsigned long count)
+{
+	unsigned long i;
+
+	for (i = 0; i < REVERSE_MAX + 2 * REVERSE_GUARD; ++i)
+		if ((i < start || i >= start + count) && buffer[i] != GUARD_VALUE)
+			return -1;
+	return 0;
+}
+
+static int reverse_check(void)
+{
+	static const unsigned long offsets[] = { 0, 1, 3, 5, 7 };
+	LADSPA_Data src[REVERSE_MAX + 2 * REVERSE_GUARD];
+	LADSPA_Data dst[REVERSE_MAX + 2 * REVERSE_GUARD];
+	unsigned long count;
+	unsigned long i;
+	size_t o;
+
+	sb_reverse_init();
+	for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); ++o) {
+		/* the source and destination are misaligned differently */
+		unsigned long out = REVERSE_GUARD + offsets[o];
+		unsigned long in = REVERSE_GUARD + (offsets[o] * 3) % 8;
+
+		for (count = 0; count <= REVERSE_MAX; ++count) {
+			for (i = 0; i < REVERSE_MAX + 2 * REVERSE_GUARD; ++i)
+				src[i] = dst[i] = GUARD_VALUE;
+			for (i = 0; i < count; ++i)
+				src[in + i] = (LADSPA_Data)(i + 1);
+
+			sb_reverse_copy(dst + out, src + in, count);
+			for (i = 0; i < count; ++i)
+				if (dst[out + i] != src[in + count - 1 - i])
+					break;
+			if (i < count || check_guards(dst, out, count) != 0
+			    || check_guards(src, in, count) != 0) {
+				fprintf(stderr, "sb_check: %s sb_reverse_copy() is wrong "
+				        "for %lu samples from offset %lu to %lu\n",
+				        sb_reverse_kernel_name(), count, in - REVERSE_GUARD,
+				        out - REVERSE_GUARD);
+				return 1;
+			}
+
+			sb_reverse_in_place(src + in, count);
+			for (i = 0; i < count; ++i)
+				if (src[in + i] != (LADSPA_Data)(count - i))
+					break;
+			if (i < count || check_guards(src, in, count) != 0) {
+				fprintf(stderr, "sb_check: %s sb_reverse_in_place() is "
+				        "wrong for %lu samples at offset %lu\n",
+				        sb_reverse_kernel_name(), count, in - REVERSE_GUARD);
+				return 1;
+			}
+		}
+	}
+
+	printf("%s\n", sb_reverse_kernel_name());
+	return 0;
+}
+
+/*****************************************************************************
+ * sb_check arena: each thread has ARENA_ARENAS arenas of its own, and fills
+ * every buffer it gets with a pattern that depends on the buffer and the
+ * offset in it.  sb_arena_alloc() zeroes what it hands out, so a buffer that
+ * overlaps a live one (from any thread) wipes part of the live one's pattern,
+ * which the next check of the live one finds.
+ *****************************************************************************/
+#define ARENA_THREADS 4
+#define ARENA_ARENAS  4
+#define ARENA_BUFFERS 16      /* per arena, before it is released */
+#define ARENA_ROUNDS  2000
+
+struct arena_buffer {
+	unsigned char * p;
+	size_t size;
+	uint32_t id;
+};
+
+struct arena_thread {
+	pthread_t thread;
+	uint32_t random;
+	uint32_t next_id;
+	sb_arena arenas[ARENA_ARENAS];
+	struct arena_buffer buffers[ARENA_ARENAS][ARENA_BUFFERS];
+	int counts[ARENA_ARENAS];
+	const char * error;
+};
+
+static uint32_t arena_random(struct arena_thread * t)
+{
+	t->random ^= t->random << 13;
+	t->random ^= t->random >> 17;
+	t->random ^= t->random << 5;
+	return t->random;
+}
+
+static unsigned char pattern(uint32_t id, size_t i)
+{
+	return (unsigned char)((id * 31u + i) % 251u + 1u);
+}
+
+/* mostly small buffers, some that take a chunk of their own, and a few over
+ * a megabyte, which get a mapping of their own */
+static size_t arena_size(struct arena_thread * t)
+{
+	uint32_t r = arena_random(t);
+
+	if (r % 64 == 0)
+		return ((size_t)1 << 20) + arena_random(t) % ((size_t)2 << 20);
+	if (r % 8 == 0)
+		return ((size_t)16 << 10) + arena_random(t) % ((size_t)496 << 10);
+	return 1 + arena_random(t) % ((size_t)16 << 10);
+}
+
+static int check_arena(struct arena_thread * t, int a)
+{
+	int b;
+	size_t i;
+
+	for (b = 0; b < t->counts[a]; ++b) {
+		const struct arena_buffer * buffer = &t->buffers[a][b];
+
+		for (i = 0; i < buffer->size; ++i)
+			if (buffer->p[i] != pattern(buffer->id, i))
+				return -1;
+	}
+	return 0;
+}
+
+static void * arena_thread(void * arg)
+{
+	struct arena_thread * t = arg;
+	int round;
+	int a;
+
+	for (a = 0; a < ARENA_ARENAS; ++a)
+		sb_arena_init(&t->arenas[a]);
+
+	for (round = 0; round < ARENA_ROUNDS && !t->error; ++round) {
+		struct arena_buffer * buffer;
+		size_t i;
+
+		a = arena_random(t) % ARENA_ARENAS;
+		if (t->counts[a] == ARENA_BUFFERS || arena_random(t) % 8 == 0) {
+			if (check_arena(t, a) != 0)
+				t->error = "a buffer was overwritten";
+			sb_arena_release(&t->arenas[a]);
+			t->counts[a] = 0;
+			continue;
+		}
+
+		buffer = &t->buffers[a][t->counts[a]];
+		buffer->size = arena_size(t);
+		buffer->id = t->next_id++;
+		buffer->p = sb_arena_alloc(&t->arenas[a], buffer->size);
+		if (!buffer->p) {
+			t->error = "sb_arena_alloc() failed";
+			break;
+		}
+		if ((uintptr_t)buffer->p % SB_ARENA_ALIGN != 0) {
+			t->error = "a buffer isn't aligned";
+			break;
+		}
+		for (i = 0; i < buffer->size; ++i)
+			if (buffer->p[i] != 0)
+				break;
+		if (i < buffer->size) {
+			t->error = "a buffer wasn't zeroed";
+			break;
+		}
+		for (i = 0; i < buffer->size; ++i)
+			buffer->p[i] = pattern(buffer->id, i);
+		++t->counts[a];
+	}
+
+	for (a = 0; a < ARENA_ARENAS; ++a) {
+		if (!t->error && check_arena(t, a) != 0)
+			t->error = "a buffer was overwritten";
+		sb_arena_release(&t->arenas[a]);
+	}
+	return NULL;
+}
+
+static int arena_check(void)
+{
+	static struct arena_thread threads[ARENA_THREADS];
+	int started = 0;
+	int result = 0;
+	int i;
+
+	for (i = 0; i < ARENA_THREADS; ++i) {
+		threads[i].random = 0x9E3779B9u * (uint32_t)(i + 1);
+		threads[i].next_id = (uint32_t)i << 24;
+		if (pthread_create(&threads[i].thread, NULL, arena_thread,
+		                   &threads[i]) != 0) {
+			fprintf(stderr, "sb_check: could not start a thread\n");
+			result = 2;
+			break;
+		}
+		++started;
+	}
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i].thread, NULL);
+		if (threads[i].error) {
+			fprintf(stderr, "sb_check: sb_arena: %s\n", threads[i].error);
+			result = 1;
+		}
+	}
+	return result;
+}
+
+/*****************************************************************************
+ * sb_check gate.  Each check prints what went wrong and returns 1, or
+ * returns 0.
+ *****************************************************************************/
+#define GATE_BLOCK 128
+
+static int silence_check(void)
+{
+	LADSPA_Data buffer[40];
+	LADSPA_Data tiny;
+	uint32_t bits = 1;            /* the smallest denormal */
+	unsigned long count;
+	unsigned long i;
+
+	memcpy(&tiny, &bits, sizeof(tiny));
+	for (count = 0; count <= 40; ++count) {
+		for (i = 0; i < count; ++i)
+			buffer[i] = (i & 1) ? -0.0f : 0.0f;
+		if (!sb_is_silent(buffer, count)) {
+			fprintf(stderr, "sb_check: sb_is_silent() says %lu samples of "
+			        "0 and -0 aren't silent\n", count);
+			return 1;
+		}
+		/* one sample of sound, in the groups of 16 and in the rest */
+		for (i = 0; i < count; ++i) {
+			buffer[i] = i % 3 ? 1e-20f : tiny;
+			if (sb_is_silent(buffer, count)) {
+				fprintf(stderr, "sb_check: sb_is_silent() misses sample "
+				        "%lu of %lu\n", i, count);
+				return 1;
+			}
+			buffer[i] = -0.0f;
+		}
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * Feeds 'blocks' blocks of silence into a gate and checks what it says of
+ * each: 'expected' lists the SB_GATE_xxx for every block.
+ *****************************************************************************/
+static int gate_sequence(sb_gate * gate, const LADSPA_Data * silence,
+                         const int * expected, int blocks, const char * what)
+{
+	int b;
+
+	for (b = 0; b < blocks; ++b) {
+		int state = sb_gate_update(gate, silence, GATE_BLOCK);
+
+		if (state != expected[b]) {
+			fprintf(stderr, "sb_check: sb_gate %s: block %d is %d, expected "
+			        "%d\n", what, b, state, expected[b]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int gate_check(void)
+{
+	/* tail 0 closes on the first silent block */
+	static const int no_tail[] = {
+		SB_GATE_CLOSING, SB_GATE_CLOSED, SB_GATE_CLOSED
+	};
+	/* a tail of 300 samples needs three silent blocks of 128 first */
+	static const int tail_300[] = {
+		SB_GATE_OPEN, SB_GATE_OPEN, SB_GATE_OPEN, SB_GATE_CLOSING,
+		SB_GATE_CLOSED
+	};
+	LADSPA_Data silence[GATE_BLOCK];
+	LADSPA_Data sound[GATE_BLOCK];
+	sb_gate gate;
+
+	sb_silence(silence, GATE_BLOCK);
+	sb_silence(sound, GATE_BLOCK);
+	sound[GATE_BLOCK - 1] = 0.25f;
+
+	sb_gate_init(&gate, 0);
+	if (gate_sequence(&gate, silence, no_tail, 3, "with no tail"))
+		return 1;
+
+	sb_gate_init(&gate, 300);
+	if (gate_sequence(&gate, silence, tail_300, 5, "with a 300 sample tail"))
+		return 1;
+
+	/* sound opens it again, and the whole tail has to go by once more */
+	if (sb_gate_update(&gate, sound, GATE_BLOCK) != SB_GATE_OPEN) {
+		fprintf(stderr, "sb_check: sb_gate doesn't open on sound\n");
+		return 1;
+	}
+	if (gate_sequence(&gate, silence, tail_300, 5, "after sound"))
+		return 1;
+
+	sb_gate_reset(&gate);
+	if (gate_sequence(&gate, silence, tail_300, 5, "after a reset"))
+		return 1;
+	return 0;
+}
+
+static int denormal_check(void)
+{
+#if defined(SB_DENORMAL_SSE)
+	volatile float tiny = 1e-39f;   /* a denormal */
+	volatile float half;
+	unsigned int before = _mm_getcsr();
+	/* round toward zero, so the check sees a mode that isn't the default */
+	unsigned int mode = (before & ~0x6000u) | 0x6000u;
+	sb_fpstate fp;
+	int result = 0;
+
+	_mm_setcsr(mode);
+	sb_denormals_off(&fp);
+	if ((_mm_getcsr() & 0x8040u) != 0x8040u) {
+		fprintf(stderr, "sb_check: sb_denormals_off() didn't set FTZ and "
+		        "DAZ\n");
+		result = 1;
+	}
+	half = tiny * 0.5f;
+	if (half != 0.0f) {
+		fprintf(stderr, "sb_check: denormals aren't flushed to zero\n");
+		result = 1;
+	}
+	sb_denormals_restore(&fp);
+	if (_mm_getcsr() != mode) {
+		fprintf(stderr, "sb_check: sb_denormals_restore() left MXCSR at %#x "
+		        "instead of %#x\n", _mm_getcsr(), mode);
+		result = 1;
+	}
+	_mm_setcsr(before);
+	return result;
+#else
+	/* only x86 is checked; elsewhere this just has to compile */
+	sb_fpstate fp;
+
+	sb_denormals_off(&fp);
+	sb_denormals_restore(&fp);
+	return 0;
+#endif
+}
+
+/*****************************************************************************
+ * sb_check control
+ *****************************************************************************/
+static int control_fail(const char * what)
+{
+	fprintf(stderr, "sb_check: sb_control: %s\n", what);
+	return 1;
+}
+
+static int control_check(void)
+{
+	sb_control control;
+	unsigned long count;
+	unsigned long i;
+	int n;
+
+	/* an unchanged port is no news, and flat */
+	sb_control_init(&control, 0.5f);
+	if (sb_control_update(&control, 0.5f, 64) != 0 || control.step != 0.0f
+	    || sb_control_ramping(&control)
+	    || sb_control_target(&control) != 0.5f)
+		return control_fail("an unchanged port isn't steady");
+
+	/* every ramp ends on its target exactly, whatever the rounding, and
+	 * the block after it is flat at the target */
+	for (n = 0; n < 200; ++n) {
+		LADSPA_Data from = (LADSPA_Data)n * 0.0137f - 1.0f;
+		LADSPA_Data to = 0.7f - (LADSPA_Data)n * 0.0031f;
+
+		for (count = 1; count <= 1024; count += 37) {
+			sb_control_init(&control, from);
+			if (sb_control_update(&control, to, count) != 1
+			    || !sb_control_ramping(&control))
+				return control_fail("a changed port isn't ramped");
+			if (sb_control_value(&control, count - 1) != to)
+				return control_fail("a ramp misses its target");
+			for (i = 1; i < count; ++i)
+				if ((to > from && sb_control_value(&control, i)
+				                  < sb_control_value(&control, i - 1))
+				    || (to < from && sb_control_value(&control, i)
+				                     > sb_control_value(&control, i - 1)))
+					return control_fail("a ramp goes the wrong way");
+
+			if (sb_control_update(&control, to, count) != 0
+			    || sb_control_ramping(&control))
+				return control_fail("the block after a ramp isn't flat");
+			for (i = 0; i < count; ++i)
+				if (sb_control_value(&control, i) != to)
+					return control_fail("the block after a ramp isn't "
+					                    "at the target");
+		}
+	}
+
+	/* a block of no samples jumps straight to the new value */
+	sb_control_init(&control, 0.5f);
+	if (sb_control_update(&control, 0.25f, 0) != 1 || control.step != 0.0f
+	    || sb_control_ramping(&control)
+	    || sb_control_target(&control) != 0.25f)
+		return control_fail("an empty block doesn't jump to the target");
+	if (sb_control_update(&control, 0.25f, 64) != 0
+	    || sb_control_ramping(&control))
+		return control_fail("the block after a jump isn't flat");
+
+	return 0;
+}
+
+/*****************************************************************************
+ * sb_check profile: call i of 1000 pretends that run() took i microseconds
+ * for 1000 samples, by moving the start time back.
+ *****************************************************************************/
+static int profile_check(void)
+{
+	sb_profile profile;
+	uint64_t i;
+
+	sb_profile_init(&profile, "sb_check");
+	for (i = 1; i <= 1000; ++i) {
+		profile.start = sb_profile_now() - i * 1000u;
+		sb_profile_end(&profile, 1000);
+	}
+	sb_profile_report(&profile);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sb_check noise output.wav frames channels rate "
+	        "seed\n"
+	        "       sb_check labels plugin.so\n"
+	        "       sb_check compare expected.wav actual.wav tolerance\n"
+	        "       sb_check reverse\n"
+	        "       sb_check arena\n"
+	        "       sb_check gate\n"
+	        "       sb_check control\n"
+	        "       sb_check profile\n");
+	exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc == 7 && strcmp(argv[1], "noise") == 0) {
+		unsigned long frames = strtoul(argv[3], NULL, 10);
+		unsigned long channels = strtoul(argv[4], NULL, 10);
+		unsigned long rate = strtoul(argv[5], NULL, 10);
+
+		if (frames == 0 || channels == 0 || channels > 64 || rate == 0)
+			usage();
+		return make_noise(argv[2], frames, (unsigned int)channels, rate,
+		                  strtoul(argv[6], NULL, 10));
+	}
+	if (argc == 3 && strcmp(argv[1], "labels") == 0)
+		return list_labels(argv[2]);
+	if (argc == 5 && strcmp(argv[1], "compare") == 0)
+		return compare(argv[2], argv[3], atof(argv[4]));
+	if (argc == 2 && strcmp(argv[1], "reverse") == 0)
+		return reverse_check();
+	if (argc == 2 && strcmp(argv[1], "arena") == 0)
+		return arena_check();
+	if (argc == 2 && strcmp(argv[1], "gate") == 0)
+		return silence_check() | gate_check() | denormal_check();
+	if (argc == 2 && strcmp(argv[1], "control") == 0)
+		return control_check();
+	if (argc == 2 && strcmp(argv[1], "profile") == 0)
+		return profile_check();
+	usage();
+	return 2;
+}
@@ -0,0 +1,125 @@
+/* sb_control.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Control port change detection and smoothing.
+ *
+ * When a host automates a control port, the value simply jumps between one
+ * run() and the next.  Used as it is, that clicks (ADT's offset, Revolution's
+ * gain), and working everything out again from the port on every sample
+ * wastes divides and conversions on the common case of a port that hasn't
+ * moved at all.  An sb_control sits between the port and the processing:
+ *
+ *     typedef struct {
+ *         ...
+ *         LADSPA_Data * offset;            (the port)
+ *         sb_control offset_control;
+ *         LADSPA_Data offset_samples;      (worked out from the port)
+ *     } Plugin;
+ *
+ *     activate:  sb_control_init(&p->offset_control, *p->offset);
+ *                p->offset_samples = ...;
+ *
+ *     run:       if (sb_control_update(&p->offset_control, *p->offset,
+ *                                      count))
+ *                    p->offset_samples = ...;     (only when it moved)
+ *
+ *                if (!sb_control_ramping(&p->offset_control)) {
+ *                    ... steady value: sb_control_target() ...
+ *                }
+ *                else {
+ *                    for (i = 0; i < count; ++i)
+ *                        ... sb_control_value(&p->offset_control, i) ...
+ *                }
+ *
+ * The value ramps linearly from the old setting to the new one across the
+ * block in which the port changed, and reaches the new setting on the last
+ * sample of it.  Ports that only make sense as whole numbers (Ringer's
+ * copy count) shouldn't be ramped; use sb_control_update() just to learn that
+ * they changed, and sb_control_target() for the value.
+ *
+ * The port is read once, at the top of run(), so a host that writes it from
+ * another thread can't change it halfway through a block, and no locks are
+ * needed (a float store is atomic on every platform we build for).
+ */
+
+#ifndef SB_CONTROL_H
+#define SB_CONTROL_H
+
+#include "ladspa.h"
+
+typedef struct {
+	LADSPA_Data start;         /* the value at the end of the last block */
+	LADSPA_Data target;        /* the port's value for this block */
+	LADSPA_Data step;          /* added per sample while ramping, or 0 */
+	unsigned long count;       /* samples in this block */
+} sb_control;
+
+/*****************************************************************************
+ * Starts the control out at 'value', with no ramp.
+ *****************************************************************************/
+static inline void sb_control_init(sb_control * control, LADSPA_Data value)
+{
+	control->start = value;
+	control->target = value;
+	control->step = 0.0f;
+	control->count = 0;
+}
+
+/*****************************************************************************
+ * Takes the port's value for a block of 'count' samples.  Returns 1 if it is
+ * different from the last block's (so anything worked out from it needs to
+ * be worked out again), 0 if not.
+ *
+ * This is the only place a divide happens, and only when the port moved.
+ *****************************************************************************/
+static inline int sb_control_update(sb_control * control, LADSPA_Data port,
+                                    unsigned long count)
+{
+	control->start = control->target;
+	control->step = 0.0f;
+	control->count = count;
+	if (port == control->target)
+		return 0;
+
+	if (count)
+		control->step = (port - control->start) / (LADSPA_Data)count;
+	control->target = port;
+	return 1;
+}
+
+/*****************************************************************************
+ * Returns 1 if the value changes during this block, 0 if it is the same on
+ * every sample (and sb_control_target() can be used throughout).
+ *****************************************************************************/
+static inline int sb_control_ramping(const sb_control * control)
+{
+	return control->step != 0.0f;
+}
+
+/*****************************************************************************
+ * Returns the port's value for this block, which the ramp ends on.
+ *****************************************************************************/
+static inline LADSPA_Data sb_control_target(const sb_control * control)
+{
+	return control->target;
+}
+
+/*****************************************************************************
+ * Returns the ramped value for sample 'i' of this block.  It is worked out
+ * back from the target, so the last sample lands on it exactly (counting up
+ * from the start, the rounding in 'step' adds up to a value just off it).
+ *****************************************************************************/
+static inline LADSPA_Data sb_control_value(const sb_control * control,
+                                           unsigned long i)
+{
+	return control->target
+	       - control->step * (LADSPA_Data)(control->count - 1 - i);
+}
+
+#endif
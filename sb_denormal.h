@@ -0,0 +1,202 @@
+/* sb_denormal.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Denormal and silence handling shared by all the StudioBlood plugins.
+ *
+ * Denormals are the tiny floating point numbers right next to zero.  A delay
+ * line or filter that is fading out on a quiet passage ends up full of them,
+ * and on x86 every operation on a denormal is many times slower than normal,
+ * which shows up as CPU spikes right when nothing is playing.  Turning on
+ * flush-to-zero (FTZ) and denormals-are-zero (DAZ) for the length of run()
+ * makes the hardware treat them as plain zeros.  Since the floating point
+ * mode belongs to the host's thread, it is put back the way it was before
+ * run() returns:
+ *
+ *     sb_fpstate fp;
+ *
+ *     sb_denormals_off(&fp);
+ *     ... process ...
+ *     sb_denormals_restore(&fp);
+ *
+ * The silence gate lets run() skip all of its work when the input is silent
+ * and the plugin has nothing left to say (its delay line or tail has drained):
+ *
+ *     switch (sb_gate_update(&plugin->gate, input, count)) {
+ *     case SB_GATE_CLOSING:
+ *         ... clear the delay line so nothing stale comes back later ...
+ *         (fall through)
+ *     case SB_GATE_CLOSED:
+ *         sb_silence(output, count);
+ *         return;
+ *     default:
+ *         break;
+ *     }
+ *
+ * Everything here is inline, since it is used once per run() and is only a
+ * few instructions long.
+ */
+
+#ifndef SB_DENORMAL_H
+#define SB_DENORMAL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ladspa.h"
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define SB_DENORMAL_SSE
+#elif defined(__aarch64__)
+#define SB_DENORMAL_AARCH64
+#endif
+
+/* The floating point mode saved by sb_denormals_off(). */
+typedef struct {
+	unsigned long saved;
+} sb_fpstate;
+
+/*****************************************************************************
+ * Turns on flush-to-zero and denormals-are-zero, saving the old mode in
+ * 'state'.  Does nothing on machines we don't know how to do it on.
+ *****************************************************************************/
+static inline void sb_denormals_off(sb_fpstate * state)
+{
+#if defined(SB_DENORMAL_SSE)
+	/* bit 15 of MXCSR is FTZ and bit 6 is DAZ */
+	unsigned int csr = _mm_getcsr();
+
+	state->saved = csr;
+	_mm_setcsr(csr | 0x8040);
+#elif defined(SB_DENORMAL_AARCH64)
+	/* bit 24 of FPCR (FZ) does both jobs on ARM */
+	uint64_t fpcr;
+
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	state->saved = fpcr;
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1UL << 24)));
+#else
+	state->saved = 0;
+#endif
+}
+
+/*****************************************************************************
+ * Puts back the floating point mode saved by sb_denormals_off().
+ *****************************************************************************/
+static inline void sb_denormals_restore(const sb_fpstate * state)
+{
+#if defined(SB_DENORMAL_SSE)
+	_mm_setcsr((unsigned int)state->saved);
+#elif defined(SB_DENORMAL_AARCH64)
+	__asm__ __volatile__("msr fpcr, %0" : : "r"((uint64_t)state->saved));
+#else
+	(void)state;
+#endif
+}
+
+/*****************************************************************************
+ * Returns 1 if every one of the 'count' samples is zero (or minus zero), 0
+ * otherwise.  The samples are checked 16 at a time, so the compiler can
+ * vectorize each group and a block with sound in it is usually given up on
+ * after the first group.
+ *****************************************************************************/
+static inline int sb_is_silent(const LADSPA_Data * buffer,
+                               unsigned long count)
+{
+	unsigned long i = 0;
+	unsigned long j;
+
+	for (; i + 16 <= count; i += 16) {
+		uint32_t bits = 0;
+
+		for (j = 0; j < 16; ++j) {
+			uint32_t sample;
+
+			memcpy(&sample, &buffer[i + j], sizeof(sample));
+			bits |= sample << 1;   /* drop the sign bit */
+		}
+		if (bits)
+			return 0;
+	}
+	for (; i < count; ++i)
+		if (buffer[i] != 0.0f)
+			return 0;
+
+	return 1;
+}
+
+/* Writes 'count' zeros. */
+static inline void sb_silence(LADSPA_Data * buffer, unsigned long count)
+{
+	memset(buffer, 0, count * sizeof(LADSPA_Data));
+}
+
+/*****************************************************************************
+ * THE SILENCE GATE
+ *
+ * The gate counts how many samples in a row the input has been silent.  Once
+ * that is at least the plugin's 'tail' (how long the plugin keeps making
+ * sound after its input stops, e.g. the length of ADT's delay line), the
+ * output is silent too and run() can skip straight to sb_silence().
+ *****************************************************************************/
+
+enum {
+	SB_GATE_OPEN = 0,     /* process as usual */
+	SB_GATE_CLOSING,      /* first skipped block: reset the plugin's state */
+	SB_GATE_CLOSED        /* still skipping: just write zeros */
+};
+
+typedef struct {
+	unsigned long tail;
+	unsigned long silent;   /* samples of silent input so far */
+	int closed;
+} sb_gate;
+
+/* Sets up a gate for a plugin that rings on for 'tail' samples. */
+static inline void sb_gate_init(sb_gate * gate, unsigned long tail)
+{
+	gate->tail = tail;
+	gate->silent = 0;
+	gate->closed = 0;
+}
+
+/* Sends the gate back to its open state, e.g. from activate(). */
+static inline void sb_gate_reset(sb_gate * gate)
+{
+	gate->silent = 0;
+	gate->closed = 0;
+}
+
+/*****************************************************************************
+ * Looks at the next block of input and returns one of SB_GATE_OPEN,
+ * SB_GATE_CLOSING or SB_GATE_CLOSED (see above).
+ *****************************************************************************/
+static inline int sb_gate_update(sb_gate * gate, const LADSPA_Data * input,
+                                 unsigned long count)
+{
+	if (!sb_is_silent(input, count)) {
+		gate->silent = 0;
+		gate->closed = 0;
+		return SB_GATE_OPEN;
+	}
+
+	/* everything still ringing came in before this block, so the output is
+	 * silent if the input was already silent for a whole tail before it */
+	if (gate->silent >= gate->tail) {
+		if (gate->closed)
+			return SB_GATE_CLOSED;
+		gate->closed = 1;
+		return SB_GATE_CLOSING;
+	}
+
+	gate->silent += count;
+	return SB_GATE_OPEN;
+}
+
+#endif
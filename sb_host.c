@@ -0,0 +1,116 @@
+/* sb_host.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Shared LADSPA host helpers for sb_bench and sb_render (see sb_host.h).
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sb_host.h"
+
+static char error_message[512] = "";
+
+void * sb_host_open(const char * path, LADSPA_Descriptor_Function * function)
+{
+	void * library;
+
+	library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!library) {
+		snprintf(error_message, sizeof(error_message), "%s", dlerror());
+		return NULL;
+	}
+
+	*function = (LADSPA_Descriptor_Function)dlsym(library,
+	                                              "ladspa_descriptor");
+	if (!*function) {
+		snprintf(error_message, sizeof(error_message),
+		         "%s is not a LADSPA plugin", path);
+		dlclose(library);
+		return NULL;
+	}
+
+	return library;
+}
+
+const LADSPA_Descriptor * sb_host_find(LADSPA_Descriptor_Function function,
+                                       const char * label)
+{
+	const LADSPA_Descriptor * d;
+	unsigned long index;
+
+	for (index = 0; (d = function(index)) != NULL; ++index)
+		if (!label || strcmp(d->Label, label) == 0)
+			return d;
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * Works out a sensible value for a control input port from its range hints,
+ * the same way a host like Audacity or Ardour would pick the default.
+ *****************************************************************************/
+LADSPA_Data sb_host_default_control(const LADSPA_PortRangeHint * hint,
+                                    unsigned long sample_rate)
+{
+	LADSPA_PortRangeHintDescriptor h = hint->HintDescriptor;
+	float lower = hint->LowerBound;
+	float upper = hint->UpperBound;
+	float value;
+
+	if (LADSPA_IS_HINT_SAMPLE_RATE(h)) {
+		lower *= (float)sample_rate;
+		upper *= (float)sample_rate;
+	}
+
+	if (LADSPA_IS_HINT_DEFAULT_0(h))
+		return 0.0f;
+	if (LADSPA_IS_HINT_DEFAULT_1(h))
+		return 1.0f;
+	if (LADSPA_IS_HINT_DEFAULT_100(h))
+		return 100.0f;
+	if (LADSPA_IS_HINT_DEFAULT_440(h))
+		return 440.0f;
+
+	/* the remaining defaults need the bounds */
+	if (LADSPA_IS_HINT_DEFAULT_MINIMUM(h))
+		value = lower;
+	else if (LADSPA_IS_HINT_DEFAULT_MAXIMUM(h))
+		value = upper;
+	else if (LADSPA_IS_HINT_DEFAULT_LOW(h))
+		value = LADSPA_IS_HINT_LOGARITHMIC(h)
+		        ? expf(logf(lower) * 0.75f + logf(upper) * 0.25f)
+		        : lower * 0.75f + upper * 0.25f;
+	else if (LADSPA_IS_HINT_DEFAULT_MIDDLE(h))
+		value = LADSPA_IS_HINT_LOGARITHMIC(h)
+		        ? expf(logf(lower) * 0.5f + logf(upper) * 0.5f)
+		        : lower * 0.5f + upper * 0.5f;
+	else if (LADSPA_IS_HINT_DEFAULT_HIGH(h))
+		value = LADSPA_IS_HINT_LOGARITHMIC(h)
+		        ? expf(logf(lower) * 0.25f + logf(upper) * 0.75f)
+		        : lower * 0.25f + upper * 0.75f;
+	else if (LADSPA_IS_HINT_BOUNDED_BELOW(h))
+		value = lower;
+	else if (LADSPA_IS_HINT_BOUNDED_ABOVE(h))
+		value = upper < 0.0f ? upper : 0.0f;
+	else
+		value = 0.0f;
+
+	if (LADSPA_IS_HINT_INTEGER(h))
+		value = floorf(value + 0.5f);
+
+	return value;
+}
+
+const char * sb_host_error(void)
+{
+	return error_message;
+}
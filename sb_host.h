@@ -0,0 +1,39 @@
+/* sb_host.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * The bits of a LADSPA host that sb_bench and sb_render have in common:
+ * loading a plugin library, finding a descriptor in it, and picking default
+ * values for control ports.
+ */
+
+#ifndef SB_HOST_H
+#define SB_HOST_H
+
+#include "ladspa.h"
+
+/* dlopen()s the shared object at 'path' and looks up its ladspa_descriptor()
+ * function.  Returns the library handle (for dlclose()) and stores the
+ * function in 'function', or returns NULL if anything went wrong, in which
+ * case sb_host_error() says what. */
+void * sb_host_open(const char * path, LADSPA_Descriptor_Function * function);
+
+/* Returns the descriptor with the given label, or the first descriptor in the
+ * library if 'label' is NULL.  Returns NULL if there is no such plugin. */
+const LADSPA_Descriptor * sb_host_find(LADSPA_Descriptor_Function function,
+                                       const char * label);
+
+/* Returns the value a host would give a control input port by default, from
+ * its range hints, at the given sample rate. */
+LADSPA_Data sb_host_default_control(const LADSPA_PortRangeHint * hint,
+                                    unsigned long sample_rate);
+
+/* Returns a message describing the last sb_host_open() failure. */
+const char * sb_host_error(void);
+
+#endif
@@ -0,0 +1,97 @@
+/* sb_isa.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Instruction set detection for the kernels (see sb_isa.h).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sb_isa.h"
+
+static const char * const names[] = { "c", "sse2", "avx2", "avx512", "neon" };
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int detected = SB_ISA_C;
+
+/*****************************************************************************
+ * Returns what the CPU can do (or, with SB_ISA_FIXED, what the compiler was
+ * told it can rely on).
+ *****************************************************************************/
+static int detect(void)
+{
+#if defined(SB_ISA_FIXED)
+#if defined(__AVX512F__)
+	return SB_ISA_AVX512;
+#elif defined(__AVX2__)
+	return SB_ISA_AVX2;
+#elif defined(__SSE2__)
+	return SB_ISA_SSE2;
+#elif defined(SB_ISA_ARM_NEON)
+	return SB_ISA_NEON;
+#else
+	return SB_ISA_C;
+#endif
+#elif defined(SB_ISA_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SB_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SB_ISA_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SB_ISA_SSE2;
+	return SB_ISA_C;
+#elif defined(SB_ISA_ARM_NEON)
+	return SB_ISA_NEON;
+#else
+	return SB_ISA_C;
+#endif
+}
+
+/*****************************************************************************
+ * Runs once, through pthread_once(), so every thread sees the same answer
+ * and nobody reads 'detected' while it is being written.
+ *****************************************************************************/
+static void pick(void)
+{
+	const char * cap;
+	int isa = detect();
+	int i;
+
+	cap = getenv("SB_ISA");
+	if (cap) {
+		for (i = SB_ISA_C; i <= SB_ISA_NEON; ++i) {
+			if (strcmp(cap, names[i]) != 0)
+				continue;
+			/* NEON and the x86 levels don't mix; "c" caps either */
+			if (i == SB_ISA_C || (isa != SB_ISA_NEON && i < isa))
+				isa = i;
+			break;
+		}
+	}
+	detected = isa;
+}
+
+int sb_isa(void)
+{
+	pthread_once(&once, pick);
+	return detected;
+}
+
+const char * sb_isa_name(int isa)
+{
+	if (isa < SB_ISA_C || isa > SB_ISA_NEON)
+		return "?";
+	return names[isa];
+}
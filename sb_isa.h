@@ -0,0 +1,62 @@
+/* sb_isa.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Which vector instructions the kernels may use.
+ *
+ * The shared kernels (sb_reverse.c so far) are built several times over,
+ * each copy for a different instruction set, and one of them is picked when
+ * the first instance is set up.  So a single .so runs on an old SSE2-only
+ * machine and still uses AVX2 or AVX-512 on a new render node, whatever
+ * -march the distribution compiled with.  A kernel family does that like
+ * this (see sb_reverse_init() for a full one):
+ *
+ *     int isa = sb_isa();
+ *
+ *     if (isa >= SB_ISA_AVX512)      kernel = kernel_avx512;
+ *     else if (isa >= SB_ISA_AVX2)   kernel = kernel_avx2;
+ *     ...
+ *
+ * with each kernel_xxx() marked __attribute__((target("..."))).  Call the
+ * family's init function from instantiate(), never from run().
+ *
+ * Setting the SB_ISA environment variable to "c", "sse2", "avx2" or "avx512"
+ * caps the choice (it can't go past what the CPU has), which is handy for
+ * comparing kernels with sb_bench or hunting a bug in one of them.  A build
+ * configured with --disable-runtime-isa (SB_ISA_FIXED) doesn't look at the
+ * CPU at all, and only uses what the compiler's -march (--with-isa)
+ * guarantees.
+ */
+
+#ifndef SB_ISA_H
+#define SB_ISA_H
+
+/* On x86 the levels are ordered, each one including the ones before it. */
+#define SB_ISA_C      0
+#define SB_ISA_SSE2   1
+#define SB_ISA_AVX2   2
+#define SB_ISA_AVX512 3     /* AVX-512 F */
+#define SB_ISA_NEON   4     /* ARM; not comparable with the x86 levels */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SB_ISA_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SB_ISA_ARM_NEON 1
+#endif
+
+/* Returns the best SB_ISA_xxx the kernels may use on this machine.  The
+ * answer is worked out once (through pthread_once()) and then cached. */
+int sb_isa(void);
+
+/* Returns the name of an SB_ISA_xxx ("c", "sse2", "avx2", "avx512" or
+ * "neon"). */
+const char * sb_isa_name(int isa);
+
+#endif
@@ -0,0 +1,105 @@
+/* sb_mix.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Write-or-accumulate output kernels, so that each plugin can give the host
+ * both run() and run_adding() from a single processing function.
+ *
+ * run() overwrites the output buffer.  run_adding() adds the plugin's output,
+ * scaled by the gain the host set with set_run_adding_gain(), on top of
+ * whatever is already in the buffer, which saves the host a scratch buffer
+ * and a second pass over memory when it mixes plugins onto a bus.  The
+ * pattern is:
+ *
+ *     static inline void process(Plugin * p, unsigned long count, int adding)
+ *     {
+ *         ...
+ *         sb_store(&p->output[i], value, p->gain, adding);
+ *         ...
+ *     }
+ *
+ *     static void run_plugin(LADSPA_Handle h, unsigned long count)
+ *     {
+ *         process((Plugin *)h, count, SB_REPLACE);
+ *     }
+ *
+ *     static void run_adding_plugin(LADSPA_Handle h, unsigned long count)
+ *     {
+ *         process((Plugin *)h, count, SB_ADD);
+ *     }
+ *
+ * Since 'adding' is a constant in each caller, the compiler builds two copies
+ * of process() with the test taken out of the inner loop.
+ */
+
+#ifndef SB_MIX_H
+#define SB_MIX_H
+
+#include <string.h>
+
+#include "ladspa.h"
+
+#define SB_REPLACE 0
+#define SB_ADD     1
+
+/* The gain a new instance should start with, until the host says otherwise
+ * with set_run_adding_gain(). */
+#define SB_DEFAULT_RUN_ADDING_GAIN 1.0f
+
+/*****************************************************************************
+ * Stores one output sample: out = value for run(), out += value * gain for
+ * run_adding().
+ *****************************************************************************/
+static inline void sb_store(LADSPA_Data * out, LADSPA_Data value,
+                            LADSPA_Data gain, int adding)
+{
+	if (adding)
+		*out += value * gain;
+	else
+		*out = value;
+}
+
+/*****************************************************************************
+ * Stores a whole block that the plugin has worked out in a scratch buffer
+ * (or can point at straight in its delay line or the input, like esreveR's
+ * and Kite's forward segments).  'src' and 'out' must not overlap.
+ *****************************************************************************/
+static inline void sb_store_block(LADSPA_Data * out, const LADSPA_Data * src,
+                                  unsigned long count, LADSPA_Data gain,
+                                  int adding)
+{
+	unsigned long i;
+
+	if (!adding) {
+		memcpy(out, src, count * sizeof(LADSPA_Data));
+		return;
+	}
+	for (i = 0; i < count; ++i)
+		out[i] += src[i] * gain;
+}
+
+/*****************************************************************************
+ * Stores 'count' copies of 'value' (a held sample, as in Ringer).
+ *****************************************************************************/
+static inline void sb_store_fill(LADSPA_Data * out, LADSPA_Data value,
+                                 unsigned long count, LADSPA_Data gain,
+                                 int adding)
+{
+	unsigned long i;
+
+	if (adding)
+		value *= gain;
+	for (i = 0; i < count; ++i) {
+		if (adding)
+			out[i] += value;
+		else
+			out[i] = value;
+	}
+}
+
+#endif
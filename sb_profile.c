@@ -0,0 +1,97 @@
+/* sb_profile.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Per-instance run() timing (see sb_profile.h).  This file compiles to
+ * nothing unless SB_ENABLE_PROFILE is defined.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sb_profile.h"
+
+#ifdef SB_ENABLE_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void sb_profile_init(sb_profile * profile, const char * label)
+{
+	memset(profile, 0, sizeof(*profile));
+	profile->label = label;
+}
+
+/*****************************************************************************
+ * Returns the middle of a histogram bucket, in picoseconds per sample (the
+ * inverse of the bucket calculation in sb_profile_end()).
+ *****************************************************************************/
+static double bucket_value(unsigned int bucket)
+{
+	unsigned int sub = bucket & ((1u << SB_PROFILE_SUB_BITS) - 1);
+	unsigned int shift = bucket >> SB_PROFILE_SUB_BITS;
+	double low;
+	double width;
+
+	if (shift == 0)
+		return (double)bucket;
+
+	low = (double)((1u << SB_PROFILE_SUB_BITS) | sub)
+	      * (double)(1ULL << (shift - 1));
+	width = (double)(1ULL << (shift - 1));
+	return low + width / 2.0;
+}
+
+/*****************************************************************************
+ * Returns the given percentile of the histogram in nanoseconds per sample.
+ *****************************************************************************/
+static double percentile(const sb_profile * profile, double fraction)
+{
+	uint64_t wanted = (uint64_t)(fraction * (double)profile->calls);
+	uint64_t seen = 0;
+	unsigned int bucket;
+
+	if (wanted >= profile->calls)
+		wanted = profile->calls - 1;
+
+	for (bucket = 0; bucket < SB_PROFILE_BUCKETS; ++bucket) {
+		seen += profile->buckets[bucket];
+		if (seen > wanted)
+			return bucket_value(bucket) / 1000.0;
+	}
+	return (double)profile->max / 1000.0;
+}
+
+/*****************************************************************************
+ * Prints one line about the instance, if SB_PROFILE asks for it.
+ *****************************************************************************/
+void sb_profile_report(const sb_profile * profile)
+{
+	const char * where = getenv("SB_PROFILE");
+	FILE * out;
+
+	if (!where || !*where || profile->calls == 0)
+		return;
+
+	if (strcmp(where, "1") == 0 || strcmp(where, "stderr") == 0)
+		out = stderr;
+	else if (!(out = fopen(where, "a")))
+		return;
+
+	fprintf(out, "sb_profile: %s %p calls=%llu p50=%.3f p99=%.3f "
+	        "max=%.3f ns/sample\n", profile->label, (const void *)profile,
+	        (unsigned long long)profile->calls, percentile(profile, 0.50),
+	        percentile(profile, 0.99), (double)profile->max / 1000.0);
+
+	if (out != stderr)
+		fclose(out);
+}
+
+#endif
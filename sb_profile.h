@@ -0,0 +1,119 @@
+/* sb_profile.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Optional per-instance timing of run(), for finding out which instance is
+ * eating the CPU when a session glitches.
+ *
+ * It is only compiled in when SB_ENABLE_PROFILE is defined (configure
+ * --enable-profile puts it in config.h, so include that first, or add
+ * -DSB_ENABLE_PROFILE to CFLAGS in Makefile_old).  Otherwise every macro
+ * below expands to nothing, so a normal build carries no trace of it.  A
+ * plugin uses it like this:
+ *
+ *     typedef struct {
+ *         ...
+ *         SB_PROFILE_FIELD
+ *     } Plugin;
+ *
+ *     instantiate:  SB_PROFILE_INIT(plugin, "sb_adt");
+ *     run:          SB_PROFILE_BEGIN(plugin);
+ *                   ... process ...
+ *                   SB_PROFILE_END(plugin, sample_count);
+ *     cleanup:      SB_PROFILE_REPORT(plugin);
+ *
+ * The report (calls, and the p50, p99 and maximum nanoseconds per sample) is
+ * only printed if the SB_PROFILE environment variable is set: to a file name
+ * to append it to that file, or to "1" or "stderr" for standard error.
+ */
+
+#ifndef SB_PROFILE_H
+#define SB_PROFILE_H
+
+#ifdef SB_ENABLE_PROFILE
+
+#include <stdint.h>
+#include <time.h>
+
+/* 4 buckets per power of two of picoseconds per sample, which is plenty of
+ * resolution for percentiles and covers everything a 64 bit count can. */
+#define SB_PROFILE_SUB_BITS 2
+#define SB_PROFILE_BUCKETS  (64 << SB_PROFILE_SUB_BITS)
+
+/* A LADSPA host never calls run() on one instance from two threads at once,
+ * so the histogram belongs to whichever thread is running the instance and
+ * needs no locks or atomics. */
+typedef struct {
+	const char * label;
+	uint64_t start;                          /* ns, at SB_PROFILE_BEGIN */
+	uint64_t calls;
+	uint64_t max;                            /* ps per sample */
+	uint32_t buckets[SB_PROFILE_BUCKETS];
+} sb_profile;
+
+void sb_profile_init(sb_profile * profile, const char * label);
+void sb_profile_report(const sb_profile * profile);
+
+static inline uint64_t sb_profile_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline void sb_profile_begin(sb_profile * profile)
+{
+	profile->start = sb_profile_now();
+}
+
+/*****************************************************************************
+ * Puts the time since sb_profile_begin() into the histogram, in picoseconds
+ * per sample.  The bucket is the position of the highest set bit plus the
+ * next SB_PROFILE_SUB_BITS bits below it.
+ *****************************************************************************/
+static inline void sb_profile_end(sb_profile * profile, unsigned long samples)
+{
+	uint64_t ps = (sb_profile_now() - profile->start) * 1000u
+	              / (samples ? samples : 1);
+	unsigned int bucket;
+
+	if (ps < (1u << SB_PROFILE_SUB_BITS)) {
+		bucket = (unsigned int)ps;
+	}
+	else {
+		unsigned int top = 63 - __builtin_clzll(ps);
+
+		bucket = ((top - SB_PROFILE_SUB_BITS + 1) << SB_PROFILE_SUB_BITS)
+		         | (unsigned int)((ps >> (top - SB_PROFILE_SUB_BITS))
+		                          & ((1u << SB_PROFILE_SUB_BITS) - 1));
+	}
+
+	++profile->buckets[bucket];
+	++profile->calls;
+	if (ps > profile->max)
+		profile->max = ps;
+}
+
+#define SB_PROFILE_FIELD          sb_profile profile;
+#define SB_PROFILE_INIT(p, label) sb_profile_init(&(p)->profile, (label))
+#define SB_PROFILE_BEGIN(p)       sb_profile_begin(&(p)->profile)
+#define SB_PROFILE_END(p, n)      sb_profile_end(&(p)->profile, (n))
+#define SB_PROFILE_REPORT(p)      sb_profile_report(&(p)->profile)
+
+#else
+
+#define SB_PROFILE_FIELD
+#define SB_PROFILE_INIT(p, label) ((void)(p))
+#define SB_PROFILE_BEGIN(p)       ((void)(p))
+#define SB_PROFILE_END(p, n)      ((void)(p))
+#define SB_PROFILE_REPORT(p)      ((void)(p))
+
+#endif
+
+#endif
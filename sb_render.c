@@ -0,0 +1,2034 @@
+/* sb_render.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Offline renderer: runs a whole sound file through a chain of StudioBlood
+ * (or any other LADSPA) plugins from the command line, without a GUI host.
+ *
+ * Usage: sb_render [-b frames] [-t frames] [-r rate] [-c channels]
+ *                  [-e format] [-f format] [-D] [-s seed]
+ *                  -p plugin.so[:label[:port=value,...]] [-p ...]
+ *                  input output
+ *        sb_render [-b frames] [-t frames] [-r rate] [-c channels]
+ *                  [-e format] [-f format] [-D] [-s seed] [-j threads]
+ *                  [-p ...] -m manifest
+ *
+ *   -b  frames read and written at a time (default 65536)
+ *   -t  frames handed to run() at a time (default: the same as -b).  A
+ *       small tile, like 256, keeps the samples in the L1 cache all the way
+ *       through the chain, so a stack of effects only goes out to main
+ *       memory once.  Plugins that work on whole host blocks (esreveR and
+ *       Kite) sound different with different tiles.
+ *   -r  sample rate of a raw input file
+ *   -c  number of channels of a raw input file
+ *   -e  sample format of a raw input file (default float)
+ *   -f  sample format of the output (default: the same as the input)
+ *   -D  don't dither 16 and 24-bit output
+ *   -s  if not 0, every plugin with a "seed" control port gets a seed
+ *       worked out from this one and the channel (and manifest line) it is
+ *       running on, so renders can be repeated exactly.  Seed ports are
+ *       floats, so every seed worked out has to be at most 16777216 (2^24,
+ *       the biggest whole number a float holds exactly): at most 16777216
+ *       minus the channels, or in batch mode minus 64 per manifest line
+ *   -j  worker threads for batch mode (default: one per CPU)
+ *   -m  render every file listed in a manifest (see BATCH MODE below; "-"
+ *       reads it from stdin)
+ *   -p  a plugin to add to the end of the chain.  'label' picks the plugin
+ *       when the library has more than one, and each 'port' (a port name or
+ *       number) is set to 'value' instead of its default.
+ *
+ * The input is either a WAV file or raw, interleaved samples (anything
+ * that doesn't start with a RIFF/WAVE header), and the output is written the
+ * same way.  The sample formats are "pcm16", "pcm24" and "pcm32" (signed
+ * integers), "float" (32-bit) and "double" (64-bit).  Samples are converted
+ * on the fly, straight from the mapped input into the first plugin's input
+ * buffers and from the last plugin's output buffers into the output block,
+ * so a 16-bit file costs no extra pass and no extra memory over a float one.
+ * Integer output is rounded with TPDF dither (except 32-bit, where it would
+ * be far below the precision of the floats it comes from) and clipped.
+ *
+ * The input file is mmap()ed instead of read, so the file never has to fit
+ * in memory, and pages that have already been rendered are handed back to
+ * the kernel as we go.  The output is double-buffered: while a separate
+ * thread write()s one block to disk, the plugins are already working on the
+ * next one, so disk I/O overlaps the DSP work.
+ *
+ * Plugins with one audio input and one output are instantiated once per
+ * channel, the way hosts like Audacity do it.  A plugin with N inputs and N
+ * outputs (like ADT's stereo pair) is instantiated once per N channels.
+ *
+ * A plugin that reports its delay through a control output port named
+ * "latency" (the convention hosts like Ardour look for) is compensated for:
+ * after the first run(), the latencies of the whole chain are added up,
+ * that many frames are dropped from the start of the output, and the chain
+ * is fed silence past the end of the input to flush them back out.  The
+ * output lines up with the input and has the same length, in a single pass.
+ *
+ * NOTE: samples are read and written in the machine's byte order, so this
+ * assumes a little endian machine, like the WAV format does.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ladspa.h"
+#include "sb_host.h"
+
+#define MAX_PLUGINS   32
+#define MAX_CHANNELS  64
+#define DEFAULT_BLOCK 65536
+
+/* WAV format tags */
+#define WAV_FORMAT_PCM        0x0001
+#define WAV_FORMAT_FLOAT      0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/* sample formats, indexes into 'formats' */
+#define FORMAT_PCM16  0
+#define FORMAT_PCM24  1
+#define FORMAT_PCM32  2
+#define FORMAT_FLOAT  3
+#define FORMAT_DOUBLE 4
+
+/* size of the header written by write_wav_header() */
+#define WAV_HEADER_SIZE 58
+
+/* where the dither generators start (see dither_seed()), for every file and
+ * every batch job, so that renders can be repeated exactly */
+#define DITHER_SEED 0x2545F491UL
+
+/* the biggest seed apply_seed() can hand to a float port without rounding it
+ * onto the seed of another channel */
+#define MAX_SEED 16777216UL
+
+static const struct {
+	const char * name;
+	unsigned int bytes;          /* per sample */
+	unsigned int tag;            /* WAV format tag */
+} formats[] = {
+	{ "pcm16", 2, WAV_FORMAT_PCM },
+	{ "pcm24", 3, WAV_FORMAT_PCM },
+	{ "pcm32", 4, WAV_FORMAT_PCM },
+	{ "float", 4, WAV_FORMAT_FLOAT },
+	{ "double", 8, WAV_FORMAT_FLOAT }
+};
+
+/* How to read raw input and how to write the output (-r, -c, -e, -f, -D). */
+struct io_options {
+	unsigned long raw_rate;
+	unsigned int raw_channels;
+	int raw_format;
+	int out_format;              /* -1 for the same as the input */
+	int dither;
+};
+
+/* A plugin as given on the command line with -p. */
+struct plugin_spec {
+	char * path;
+	char * label;      /* NULL for the first plugin in the library */
+	char * settings;   /* "port=value,port=value", or NULL */
+};
+
+/* An input file, mapped into memory. */
+struct sound_file {
+	unsigned char * map;
+	size_t map_size;
+	const unsigned char * data;   /* first sample */
+	unsigned long frames;
+	unsigned int channels;
+	unsigned long rate;
+	int format;                   /* FORMAT_xxx */
+	int is_wav;
+	dev_t dev;                    /* which file it is, so it can't be */
+	ino_t ino;                    /* overwritten by the output */
+};
+
+/* One link of the chain: as many instances of one plugin as it takes to
+ * cover every channel. */
+struct stage {
+	void * library;
+	const LADSPA_Descriptor * d;
+	unsigned int ports;          /* audio inputs (= outputs) per instance */
+	unsigned int count;          /* number of instances */
+	LADSPA_Handle * instances;
+	LADSPA_Data * controls;      /* PortCount values per instance */
+	long latency_port;           /* "latency" control output, or -1 */
+};
+
+/* The whole chain.  There are two sets of channel buffers: stage 0 reads
+ * from set 0 and writes to set 1, stage 1 reads set 1 and writes set 0, and
+ * so on.  That way the ports only have to be connected once, and no plugin
+ * ever runs in place. */
+struct chain {
+	struct stage stages[MAX_PLUGINS];
+	int stage_count;
+	unsigned int channels;
+	unsigned long block;
+	LADSPA_Data * buffers[2];    /* channel c starts at buffers[s] + c*block */
+};
+
+/* The asynchronous, double-buffered output. */
+struct writer {
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char * buffers[2];
+	size_t lengths[2];
+	int full[2];
+	int next;                    /* buffer the renderer fills next */
+	int stop;
+	int error;
+};
+
+/*****************************************************************************
+ * Little endian helpers for the WAV header.
+ *****************************************************************************/
+static unsigned int get_u16(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned long get_u32(const unsigned char * p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8)
+	       | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static void put_u16(unsigned char * p, unsigned int v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_u32(unsigned char * p, unsigned long v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+/*****************************************************************************
+ * Finds the format and the sample data of a mapped WAV file.
+ *
+ * Returns 0 on success, -1 if it isn't a WAV file we can render.
+ *****************************************************************************/
+static int parse_wav(struct sound_file * file)
+{
+	const unsigned char * p = file->map + 12;
+	const unsigned char * end = file->map + file->map_size;
+	unsigned int format = 0;
+	unsigned int bits = 0;
+	int have_format = 0;
+
+	while (p + 8 <= end) {
+		unsigned long size = get_u32(p + 4);
+		const unsigned char * body = p + 8;
+
+		if (memcmp(p, "fmt ", 4) == 0 && size >= 16 && body + 16 <= end) {
+			format = get_u16(body);
+			file->channels = get_u16(body + 2);
+			file->rate = get_u32(body + 4);
+			bits = get_u16(body + 14);
+			/* the real format tag of an extensible file is the first two
+			 * bytes of its sub-format GUID */
+			if (format == WAV_FORMAT_EXTENSIBLE && size >= 26
+			    && body + 26 <= end)
+				format = get_u16(body + 24);
+			have_format = 1;
+		}
+		else if (memcmp(p, "data", 4) == 0) {
+			if (!have_format)
+				break;
+			if (format == WAV_FORMAT_PCM && bits == 16)
+				file->format = FORMAT_PCM16;
+			else if (format == WAV_FORMAT_PCM && bits == 24)
+				file->format = FORMAT_PCM24;
+			else if (format == WAV_FORMAT_PCM && bits == 32)
+				file->format = FORMAT_PCM32;
+			else if (format == WAV_FORMAT_FLOAT && bits == 32)
+				file->format = FORMAT_FLOAT;
+			else if (format == WAV_FORMAT_FLOAT && bits == 64)
+				file->format = FORMAT_DOUBLE;
+			else {
+				fprintf(stderr, "sb_render: only 16, 24 and 32-bit PCM and "
+				        "32 and 64-bit float WAV files are supported\n");
+				return -1;
+			}
+			if (file->channels == 0)
+				break;
+			/* a streamed or over-sized file may claim more data than
+			 * there is; just take what's actually there */
+			if (size > (unsigned long)(end - body))
+				size = end - body;
+			file->data = body;
+			file->frames = size / (file->channels
+			                       * formats[file->format].bytes);
+			return 0;
+		}
+
+		/* chunks are padded to an even number of bytes */
+		if (size > (unsigned long)(end - body))
+			break;
+		p = body + size + (size & 1);
+	}
+
+	fprintf(stderr, "sb_render: malformed WAV file\n");
+	return -1;
+}
+
+/*****************************************************************************
+ * Maps the input file into memory and works out what's in it.  The raw_xxx
+ * options are only used if the file turns out to be raw.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int open_input(const char * path, struct sound_file * file,
+                      const struct io_options * options)
+{
+	struct stat st;
+	int fd;
+
+	memset(file, 0, sizeof(*file));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "sb_render: %s: %s\n", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		fprintf(stderr, "sb_render: %s is empty\n", path);
+		close(fd);
+		return -1;
+	}
+
+	file->dev = st.st_dev;
+	file->ino = st.st_ino;
+	file->map_size = st.st_size;
+	file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file->map == MAP_FAILED) {
+		fprintf(stderr, "sb_render: %s: %s\n", path, strerror(errno));
+		file->map = NULL;
+		return -1;
+	}
+	madvise(file->map, file->map_size, MADV_SEQUENTIAL);
+
+	if (file->map_size >= 12 && memcmp(file->map, "RIFF", 4) == 0
+	    && memcmp(file->map + 8, "WAVE", 4) == 0) {
+		file->is_wav = 1;
+		if (parse_wav(file) != 0)
+			return -1;
+	}
+	else {
+		if (options->raw_rate == 0 || options->raw_channels == 0) {
+			fprintf(stderr, "sb_render: %s is not a WAV file; give its "
+			        "sample rate and channels with -r and -c\n", path);
+			return -1;
+		}
+		file->rate = options->raw_rate;
+		file->channels = options->raw_channels;
+		file->format = options->raw_format;
+		file->data = file->map;
+		file->frames = file->map_size / (file->channels
+		                                 * formats[file->format].bytes);
+	}
+
+	if (file->channels > MAX_CHANNELS) {
+		fprintf(stderr, "sb_render: too many channels (%u)\n",
+		        file->channels);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void close_input(struct sound_file * file)
+{
+	if (file->map)
+		munmap(file->map, file->map_size);
+	file->map = NULL;
+}
+
+/*****************************************************************************
+ * Opens an output file for writing, but doesn't truncate it yet: if it is
+ * the same file as an input (under another name, or through a link),
+ * truncating it would pull the pages out from under the input's mapping and
+ * kill us with SIGBUS.  'st' is filled in for is_input().
+ *
+ * Returns the file descriptor, or -1 on failure.
+ *****************************************************************************/
+static int open_output(const char * path, int flags, struct stat * st)
+{
+	int fd = open(path, flags | O_CREAT, 0644);
+
+	if (fd >= 0 && fstat(fd, st) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0)
+		fprintf(stderr, "sb_render: %s: %s\n", path, strerror(errno));
+	return fd;
+}
+
+/*****************************************************************************
+ * Returns 1 if the output file described by 'st' is the input 'file'.
+ *****************************************************************************/
+static int is_input(const struct stat * st, const struct sound_file * file)
+{
+	return st->st_dev == file->dev && st->st_ino == file->ino;
+}
+
+/*****************************************************************************
+ * Tells the kernel that the input before 'frame' won't be needed again, so
+ * the mapping doesn't pin the whole file in memory as rendering goes on.
+ *****************************************************************************/
+static void release_input(struct sound_file * file, unsigned long frame)
+{
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)file->map;
+	uintptr_t end = (uintptr_t)(file->data + (size_t)frame * file->channels
+	                            * formats[file->format].bytes);
+
+	end &= ~(page - 1);
+	if (end > start)
+		madvise(file->map, end - start, MADV_DONTNEED);
+}
+
+/*****************************************************************************
+ * Fills in the WAV header for 'frames' frames in the given sample format.
+ *****************************************************************************/
+static void make_wav_header(unsigned char * h, unsigned int channels,
+                            unsigned long rate, uint64_t frames, int format)
+{
+	unsigned int bytes = formats[format].bytes;
+	uint64_t data_size = frames * channels * bytes;
+	unsigned long size32;
+
+	/* the sizes in a WAV file are 32 bits; files bigger than that are
+	 * marked as 'as long as the file', which most readers understand */
+	size32 = data_size + WAV_HEADER_SIZE - 8 > 0xFFFFFFFFUL
+	         ? 0xFFFFFFFFUL : (unsigned long)data_size;
+
+	memcpy(h, "RIFF", 4);
+	put_u32(h + 4, size32 == 0xFFFFFFFFUL ? size32
+	                                      : size32 + WAV_HEADER_SIZE - 8);
+	memcpy(h + 8, "WAVE", 4);
+
+	memcpy(h + 12, "fmt ", 4);
+	put_u32(h + 16, 18);
+	put_u16(h + 20, formats[format].tag);
+	put_u16(h + 22, channels);
+	put_u32(h + 24, rate);
+	put_u32(h + 28, rate * channels * bytes);
+	put_u16(h + 32, channels * bytes);
+	put_u16(h + 34, bytes * 8);
+	put_u16(h + 36, 0);
+
+	/* non-PCM files are supposed to have a 'fact' chunk, and it does no
+	 * harm in a PCM one, so every header is the same size */
+	memcpy(h + 38, "fact", 4);
+	put_u32(h + 42, 4);
+	put_u32(h + 46, frames > 0xFFFFFFFFUL ? 0xFFFFFFFFUL
+	                                      : (unsigned long)frames);
+
+	memcpy(h + 50, "data", 4);
+	put_u32(h + 54, size32);
+}
+
+/*****************************************************************************
+ * Writes the WAV header at the start of an output file.  This is done once
+ * rendering is finished, when the length is known.
+ *****************************************************************************/
+static int write_wav_header(int fd, unsigned int channels, unsigned long rate,
+                            uint64_t frames, int format)
+{
+	unsigned char h[WAV_HEADER_SIZE];
+
+	make_wav_header(h, channels, rate, frames, format);
+	if (pwrite(fd, h, sizeof(h), 0) != (ssize_t)sizeof(h))
+		return -1;
+	return 0;
+}
+
+/*****************************************************************************
+ * Sets the control ports listed in 'settings' ("port=value,...") on every
+ * instance of a stage.
+ *
+ * Returns 0 on success, -1 if a port doesn't exist or a value is bad.
+ *****************************************************************************/
+static int apply_settings(struct stage * stage, const char * settings)
+{
+	const LADSPA_Descriptor * d = stage->d;
+	char * copy;
+	char * item;
+	char * save;
+
+	if (!settings || !*settings)
+		return 0;
+
+	copy = strdup(settings);
+	if (!copy)
+		return -1;
+
+	for (item = strtok_r(copy, ",", &save); item;
+	     item = strtok_r(NULL, ",", &save)) {
+		char * equals = strchr(item, '=');
+		char * end;
+		unsigned long port;
+		float value;
+		unsigned int k;
+
+		if (!equals) {
+			fprintf(stderr, "sb_render: %s: expected port=value, got "
+			        "'%s'\n", d->Label, item);
+			free(copy);
+			return -1;
+		}
+		*equals = '\0';
+
+		/* a port can be given by number or by name */
+		port = strtoul(item, &end, 10);
+		if (end == item || *end) {
+			for (port = 0; port < d->PortCount; ++port)
+				if (strcasecmp(d->PortNames[port], item) == 0)
+					break;
+		}
+		if (port >= d->PortCount
+		    || !LADSPA_IS_PORT_CONTROL(d->PortDescriptors[port])
+		    || !LADSPA_IS_PORT_INPUT(d->PortDescriptors[port])) {
+			fprintf(stderr, "sb_render: %s has no control input '%s'\n",
+			        d->Label, item);
+			free(copy);
+			return -1;
+		}
+
+		value = strtof(equals + 1, &end);
+		if (end == equals + 1 || *end) {
+			fprintf(stderr, "sb_render: %s: bad value '%s'\n", d->Label,
+			        equals + 1);
+			free(copy);
+			return -1;
+		}
+
+		for (k = 0; k < stage->count; ++k)
+			stage->controls[k * d->PortCount + port] = value;
+	}
+
+	free(copy);
+	return 0;
+}
+
+/*****************************************************************************
+ * Gives every instance of a stage that has a "seed" control port its own
+ * seed: 'seed' for the instance on the chain's first channel, 'seed' + 1 for
+ * the next channel, and so on.  The seed depends only on the channel, never
+ * on which thread or in which order things run, so re-renders come out the
+ * same.
+ *****************************************************************************/
+static void apply_seed(struct stage * stage, unsigned long seed)
+{
+	const LADSPA_Descriptor * d = stage->d;
+	unsigned long port;
+	unsigned int k;
+
+	for (port = 0; port < d->PortCount; ++port)
+		if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[port])
+		    && LADSPA_IS_PORT_INPUT(d->PortDescriptors[port])
+		    && strcasecmp(d->PortNames[port], "seed") == 0)
+			break;
+	if (port == d->PortCount)
+		return;
+
+	for (k = 0; k < stage->count; ++k)
+		stage->controls[k * d->PortCount + port] =
+			(LADSPA_Data)(seed + (unsigned long)k * stage->ports);
+}
+
+/*****************************************************************************
+ * Loads, instantiates, connects and activates one stage of the chain.  It
+ * reads from buffer set 'in' and writes to buffer set 'in ^ 1'.  If 'seed' is
+ * not 0 it is handed to the plugin's seed port (see apply_seed()).
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int open_stage(struct chain * chain, struct stage * stage,
+                      const struct plugin_spec * spec, unsigned long rate,
+                      int in, unsigned long seed)
+{
+	LADSPA_Descriptor_Function function;
+	const LADSPA_Descriptor * d;
+	unsigned int inputs = 0;
+	unsigned int outputs = 0;
+	unsigned long port;
+	unsigned int k;
+
+	stage->library = sb_host_open(spec->path, &function);
+	if (!stage->library) {
+		fprintf(stderr, "sb_render: %s\n", sb_host_error());
+		return -1;
+	}
+
+	d = sb_host_find(function, spec->label);
+	if (!d) {
+		fprintf(stderr, "sb_render: %s: no plugin labelled '%s'\n",
+		        spec->path, spec->label ? spec->label : "");
+		return -1;
+	}
+	stage->d = d;
+
+	for (port = 0; port < d->PortCount; ++port) {
+		if (!LADSPA_IS_PORT_AUDIO(d->PortDescriptors[port]))
+			continue;
+		if (LADSPA_IS_PORT_INPUT(d->PortDescriptors[port]))
+			++inputs;
+		else
+			++outputs;
+	}
+	if (inputs == 0 || inputs != outputs || chain->channels % inputs != 0) {
+		fprintf(stderr, "sb_render: %s has %u inputs and %u outputs, which "
+		        "doesn't fit %u channels\n", d->Label, inputs, outputs,
+		        chain->channels);
+		return -1;
+	}
+	stage->ports = inputs;
+	stage->count = chain->channels / inputs;
+
+	stage->latency_port = -1;
+	for (port = 0; port < d->PortCount; ++port)
+		if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[port])
+		    && LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[port])
+		    && strcasecmp(d->PortNames[port], "latency") == 0)
+			stage->latency_port = (long)port;
+
+	stage->instances = calloc(stage->count, sizeof(LADSPA_Handle));
+	stage->controls = calloc((size_t)stage->count * d->PortCount,
+	                         sizeof(LADSPA_Data));
+	if (!stage->instances || !stage->controls) {
+		fprintf(stderr, "sb_render: out of memory\n");
+		return -1;
+	}
+
+	for (k = 0; k < stage->count; ++k)
+		for (port = 0; port < d->PortCount; ++port)
+			if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[port])
+			    && LADSPA_IS_PORT_INPUT(d->PortDescriptors[port]))
+				stage->controls[k * d->PortCount + port] =
+					sb_host_default_control(&d->PortRangeHints[port], rate);
+
+	/* the seed goes in before the settings so an explicit seed=... on the
+	 * command line still wins */
+	if (seed)
+		apply_seed(stage, seed);
+	if (apply_settings(stage, spec->settings) != 0)
+		return -1;
+
+	for (k = 0; k < stage->count; ++k) {
+		unsigned int channel_in = k * stage->ports;
+		unsigned int channel_out = k * stage->ports;
+
+		stage->instances[k] = d->instantiate(d, rate);
+		if (!stage->instances[k]) {
+			fprintf(stderr, "sb_render: could not instantiate %s\n",
+			        d->Label);
+			return -1;
+		}
+
+		for (port = 0; port < d->PortCount; ++port) {
+			LADSPA_PortDescriptor pd = d->PortDescriptors[port];
+			LADSPA_Data * location;
+
+			if (!LADSPA_IS_PORT_AUDIO(pd))
+				location = &stage->controls[k * d->PortCount + port];
+			else if (LADSPA_IS_PORT_INPUT(pd))
+				location = chain->buffers[in]
+				           + (size_t)channel_in++ * chain->block;
+			else
+				location = chain->buffers[in ^ 1]
+				           + (size_t)channel_out++ * chain->block;
+			d->connect_port(stage->instances[k], port, location);
+		}
+
+		if (d->activate)
+			d->activate(stage->instances[k]);
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * Tears down everything open_chain() or open_stage() managed to set up.
+ *****************************************************************************/
+static void close_chain(struct chain * chain)
+{
+	int s;
+	unsigned int k;
+
+	for (s = 0; s < chain->stage_count; ++s) {
+		struct stage * stage = &chain->stages[s];
+
+		if (stage->instances) {
+			for (k = 0; k < stage->count; ++k) {
+				if (!stage->instances[k])
+					continue;
+				if (stage->d->deactivate)
+					stage->d->deactivate(stage->instances[k]);
+				stage->d->cleanup(stage->instances[k]);
+			}
+		}
+		free(stage->instances);
+		free(stage->controls);
+		if (stage->library)
+			dlclose(stage->library);
+	}
+	free(chain->buffers[0]);
+	free(chain->buffers[1]);
+	memset(chain, 0, sizeof(*chain));
+}
+
+/*****************************************************************************
+ * Sets up the whole chain of plugins for 'channels' channels of sound.
+ * 'seed' is the seed for the first channel, or 0 to leave seed ports alone.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int open_chain(struct chain * chain, const struct plugin_spec * specs,
+                      int spec_count, unsigned int channels,
+                      unsigned long rate, unsigned long block,
+                      unsigned long seed)
+{
+	size_t size = (size_t)channels * block * sizeof(LADSPA_Data);
+	void * memory[2] = { NULL, NULL };
+	int s;
+
+	memset(chain, 0, sizeof(*chain));
+	chain->channels = channels;
+	chain->block = block;
+
+	if (posix_memalign(&memory[0], 64, size) != 0
+	    || posix_memalign(&memory[1], 64, size) != 0) {
+		free(memory[0]);
+		fprintf(stderr, "sb_render: out of memory\n");
+		return -1;
+	}
+	chain->buffers[0] = memory[0];
+	chain->buffers[1] = memory[1];
+	memset(chain->buffers[1], 0, size);
+
+	for (s = 0; s < spec_count; ++s) {
+		++chain->stage_count;
+		if (open_stage(chain, &chain->stages[s], &specs[s], rate, s & 1,
+		               seed) != 0) {
+			close_chain(chain);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * Runs 'frames' frames from buffer set 0 through every stage, and returns the
+ * buffer set holding the result.
+ *****************************************************************************/
+static LADSPA_Data * run_chain(struct chain * chain, unsigned long frames)
+{
+	int s;
+	unsigned int k;
+
+	for (s = 0; s < chain->stage_count; ++s) {
+		struct stage * stage = &chain->stages[s];
+
+		for (k = 0; k < stage->count; ++k)
+			stage->d->run(stage->instances[k], frames);
+	}
+
+	return chain->buffers[chain->stage_count & 1];
+}
+
+/*****************************************************************************
+ * Returns the delay of the whole chain in frames: the sum of what each stage
+ * reports on its "latency" port.  Only meaningful after the first run().
+ *****************************************************************************/
+static unsigned long chain_latency(const struct chain * chain)
+{
+	unsigned long total = 0;
+	int s;
+
+	for (s = 0; s < chain->stage_count; ++s) {
+		const struct stage * stage = &chain->stages[s];
+		LADSPA_Data latency;
+
+		if (stage->latency_port < 0)
+			continue;
+		/* every instance of a stage is the same plugin with the same
+		 * settings, so the first one speaks for all of them */
+		latency = stage->controls[stage->latency_port];
+		if (latency > 0.0f && latency < 2147483648.0f)
+			total += (unsigned long)(latency + 0.5f);
+	}
+
+	return total;
+}
+
+/*****************************************************************************
+ * The writer thread: writes each buffer the renderer fills, in turn, until
+ * it is told to stop and there is nothing left to write.
+ *****************************************************************************/
+static void * writer_thread(void * arg)
+{
+	struct writer * w = arg;
+	int index = 0;
+
+	for (;;) {
+		const unsigned char * p;
+		size_t left;
+		int error = 0;
+
+		pthread_mutex_lock(&w->lock);
+		while (!w->full[index] && !w->stop)
+			pthread_cond_wait(&w->cond, &w->lock);
+		if (!w->full[index]) {
+			pthread_mutex_unlock(&w->lock);
+			break;
+		}
+		pthread_mutex_unlock(&w->lock);
+
+		p = w->buffers[index];
+		left = w->lengths[index];
+		while (left > 0) {
+			ssize_t n = write(w->fd, p, left);
+
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				error = errno;
+				break;
+			}
+			p += n;
+			left -= n;
+		}
+
+		pthread_mutex_lock(&w->lock);
+		if (error && !w->error)
+			w->error = error;
+		w->full[index] = 0;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+
+		index ^= 1;
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * Starts a writer appending to 'fd', with two buffers of 'size' bytes.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int start_writer(struct writer * w, int fd, size_t size)
+{
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->buffers[0] = malloc(size);
+	w->buffers[1] = malloc(size);
+	if (!w->buffers[0] || !w->buffers[1]) {
+		free(w->buffers[0]);
+		free(w->buffers[1]);
+		return -1;
+	}
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->cond);
+		free(w->buffers[0]);
+		free(w->buffers[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * Returns the next buffer to fill, waiting for the writer to finish with it
+ * if it has to.
+ *****************************************************************************/
+static unsigned char * writer_buffer(struct writer * w)
+{
+	pthread_mutex_lock(&w->lock);
+	while (w->full[w->next])
+		pthread_cond_wait(&w->cond, &w->lock);
+	pthread_mutex_unlock(&w->lock);
+
+	return w->buffers[w->next];
+}
+
+/* Hands the buffer from writer_buffer() over to the writer thread. */
+static void writer_submit(struct writer * w, size_t length)
+{
+	pthread_mutex_lock(&w->lock);
+	w->lengths[w->next] = length;
+	w->full[w->next] = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	w->next ^= 1;
+}
+
+/*****************************************************************************
+ * Waits for everything to be written and stops the writer thread.
+ *
+ * Returns 0 if every write succeeded, or the errno of the first that failed.
+ *****************************************************************************/
+static int stop_writer(struct writer * w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->stop = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	free(w->buffers[0]);
+	free(w->buffers[1]);
+
+	return w->error;
+}
+
+/*****************************************************************************
+ * Splits 'frames' interleaved frames starting at 'first' into the chain's
+ * input channel buffers.  Only the 'count' channels starting at 'channel'
+ * are read.
+ *****************************************************************************/
+static void read_frames(const struct sound_file * file, unsigned long first,
+                        unsigned long frames, unsigned int channel,
+                        unsigned int count, LADSPA_Data * buffers,
+                        unsigned long block)
+{
+	unsigned int bytes = formats[file->format].bytes;
+	size_t stride = (size_t)file->channels * bytes;
+	const unsigned char * start = file->data + (size_t)first * stride
+	                              + (size_t)channel * bytes;
+	unsigned int c;
+	unsigned long i;
+
+	/* the samples are copied out with memcpy() since nothing says they're
+	 * aligned; the compiler turns each one into a plain load */
+	for (c = 0; c < count; ++c) {
+		LADSPA_Data * dst = buffers + (size_t)c * block;
+		const unsigned char * src = start + (size_t)c * bytes;
+
+		switch (file->format) {
+		case FORMAT_PCM16:
+			for (i = 0; i < frames; ++i) {
+				int16_t v;
+
+				memcpy(&v, src + i * stride, sizeof(v));
+				dst[i] = (LADSPA_Data)v * (1.0f / 32768.0f);
+			}
+			break;
+		case FORMAT_PCM24:
+			for (i = 0; i < frames; ++i) {
+				const unsigned char * b = src + i * stride;
+				int32_t v = (int32_t)((uint32_t)b[0] << 8
+				                      | (uint32_t)b[1] << 16
+				                      | (uint32_t)b[2] << 24) >> 8;
+
+				dst[i] = (LADSPA_Data)v * (1.0f / 8388608.0f);
+			}
+			break;
+		case FORMAT_PCM32:
+			for (i = 0; i < frames; ++i) {
+				int32_t v;
+
+				memcpy(&v, src + i * stride, sizeof(v));
+				dst[i] = (LADSPA_Data)((double)v * (1.0 / 2147483648.0));
+			}
+			break;
+		case FORMAT_FLOAT:
+			for (i = 0; i < frames; ++i)
+				memcpy(&dst[i], src + i * stride, sizeof(float));
+			break;
+		case FORMAT_DOUBLE:
+			for (i = 0; i < frames; ++i) {
+				double v;
+
+				memcpy(&v, src + i * stride, sizeof(v));
+				dst[i] = (LADSPA_Data)v;
+			}
+			break;
+		}
+	}
+}
+
+/*****************************************************************************
+ * Reads 'frames' frames starting at frame 'first' into the chain (with
+ * silence for any that are past the end of the file) and runs them through
+ * it.  Returns the buffer set holding the result.
+ *****************************************************************************/
+static LADSPA_Data * feed_chain(struct chain * chain,
+                                const struct sound_file * file,
+                                unsigned long first, unsigned long frames,
+                                unsigned int channel)
+{
+	unsigned long have = 0;
+	unsigned int c;
+
+	if (first < file->frames)
+		have = file->frames - first < frames ? file->frames - first : frames;
+	if (have)
+		read_frames(file, first, have, channel, chain->channels,
+		            chain->buffers[0], chain->block);
+	if (have < frames)
+		for (c = 0; c < chain->channels; ++c)
+			memset(chain->buffers[0] + (size_t)c * chain->block + have, 0,
+			       (frames - have) * sizeof(LADSPA_Data));
+
+	return run_chain(chain, frames);
+}
+
+/*****************************************************************************
+ * Returns triangular (TPDF) dither noise between -1 and 1 LSB: the difference
+ * of two uniform random numbers, from a xorshift generator.
+ *****************************************************************************/
+static inline double tpdf(uint32_t * state)
+{
+	uint32_t a;
+	uint32_t b;
+
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	a = *state;
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	b = *state;
+
+	return ((double)a - (double)b) * (1.0 / 4294967296.0);
+}
+
+/*****************************************************************************
+ * Returns the starting state of output channel 'channel''s dither generator.
+ * Every channel has a generator of its own, so the dither on a channel
+ * doesn't depend on how the frames are split into tiles, or on whether the
+ * channel is rendered alone (in a batch job) or with the others.  The seeds
+ * go through the splitmix64 finalizer: xorshift states that start out close
+ * together give correlated noise for a while.
+ *****************************************************************************/
+static uint32_t dither_seed(unsigned int channel)
+{
+	uint64_t z = DITHER_SEED + 0x9E3779B97F4A7C15ULL * (channel + 1);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+
+	/* xorshift never leaves 0 */
+	return (uint32_t)z ? (uint32_t)z : (uint32_t)DITHER_SEED;
+}
+
+/*****************************************************************************
+ * Scales a sample to an integer of 'max' + 1 steps each side of 0, adding
+ * dither if 'dither' isn't NULL, and rounds and clips it.
+ *****************************************************************************/
+static inline int32_t quantize(LADSPA_Data x, double max, uint32_t * dither)
+{
+	double v = (double)x * (max + 1.0);
+
+	if (dither)
+		v += tpdf(dither);
+	v = floor(v + 0.5);
+	if (v > max)
+		v = max;
+	else if (v < -max - 1.0)
+		v = -max - 1.0;
+	else if (v != v)
+		v = 0.0;
+	return (int32_t)v;
+}
+
+/*****************************************************************************
+ * Interleaves 'frames' frames of the chain's 'count' output channel buffers
+ * into 'out', which holds 'channels' channels per frame in the given sample
+ * format, starting at channel 'channel'.  'dither' holds the state of every
+ * output channel's dither generator, indexed from channel 0 of the output
+ * (NULL for none); it is only used for 16 and 24-bit output.
+ *****************************************************************************/
+static void write_frames(unsigned char * out, const LADSPA_Data * buffers,
+                         unsigned int channels, unsigned int channel,
+                         unsigned int count, unsigned long frames,
+                         unsigned long block, int format, uint32_t * dither)
+{
+	unsigned int bytes = formats[format].bytes;
+	size_t stride = (size_t)channels * bytes;
+	unsigned char * start = out + (size_t)channel * bytes;
+	unsigned int c;
+	unsigned long i;
+
+	for (c = 0; c < count; ++c) {
+		const LADSPA_Data * src = buffers + (size_t)c * block;
+		unsigned char * dst = start + (size_t)c * bytes;
+		uint32_t * state = dither ? &dither[channel + c] : NULL;
+
+		switch (format) {
+		case FORMAT_PCM16:
+			for (i = 0; i < frames; ++i) {
+				int16_t v = (int16_t)quantize(src[i], 32767.0, state);
+
+				memcpy(dst + i * stride, &v, sizeof(v));
+			}
+			break;
+		case FORMAT_PCM24:
+			for (i = 0; i < frames; ++i) {
+				int32_t v = quantize(src[i], 8388607.0, state);
+				unsigned char * b = dst + i * stride;
+
+				b[0] = v & 0xFF;
+				b[1] = (v >> 8) & 0xFF;
+				b[2] = (v >> 16) & 0xFF;
+			}
+			break;
+		case FORMAT_PCM32:
+			for (i = 0; i < frames; ++i) {
+				int32_t v = quantize(src[i], 2147483647.0, NULL);
+
+				memcpy(dst + i * stride, &v, sizeof(v));
+			}
+			break;
+		case FORMAT_FLOAT:
+			for (i = 0; i < frames; ++i)
+				memcpy(dst + i * stride, &src[i], sizeof(float));
+			break;
+		case FORMAT_DOUBLE:
+			for (i = 0; i < frames; ++i) {
+				double v = src[i];
+
+				memcpy(dst + i * stride, &v, sizeof(v));
+			}
+			break;
+		}
+	}
+}
+
+/*****************************************************************************
+ * Returns 0 if 'largest', the biggest seed a render works out from -s, fits
+ * in a seed port.  Otherwise complains and returns -1.
+ *****************************************************************************/
+static int check_seed(unsigned long seed, unsigned long largest)
+{
+	if (seed == 0 || largest <= MAX_SEED)
+		return 0;
+	fprintf(stderr, "sb_render: -s %lu is too big: this render needs seeds up "
+	        "to %lu, and seed ports only hold whole numbers up to %lu "
+	        "exactly\n", seed, largest, MAX_SEED);
+	return -1;
+}
+
+/*****************************************************************************
+ * Renders one input file through the chain into one output file.  The file
+ * is read and written 'block' frames at a time, and each block goes through
+ * the chain 'tile' frames at a time.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int render_file(const char * input, const char * output,
+                       const struct plugin_spec * specs, int spec_count,
+                       unsigned long block, unsigned long tile,
+                       const struct io_options * options, unsigned long seed)
+{
+	struct sound_file file;
+	struct chain chain;
+	struct writer writer;
+	struct stat st;
+	unsigned long written = 0;   /* output frames */
+	unsigned long fed = 0;       /* input frames, including silence */
+	unsigned long skip = 0;      /* output frames still to drop */
+	uint32_t dither[MAX_CHANNELS];
+	unsigned int c;
+	int format;
+	size_t frame_size;           /* of the output */
+	int fd;
+	int error;
+
+	if (open_input(input, &file, options) != 0) {
+		close_input(&file);
+		return -1;
+	}
+	format = options->out_format >= 0 ? options->out_format : file.format;
+	for (c = 0; c < file.channels; ++c)
+		dither[c] = dither_seed(c);
+	frame_size = (size_t)file.channels * formats[format].bytes;
+	if (check_seed(seed, seed + file.channels - 1) != 0) {
+		close_input(&file);
+		return -1;
+	}
+
+	if (open_chain(&chain, specs, spec_count, file.channels, file.rate,
+	               tile, seed) != 0) {
+		close_input(&file);
+		return -1;
+	}
+
+	fd = open_output(output, O_WRONLY, &st);
+	if (fd < 0) {
+		close_chain(&chain);
+		close_input(&file);
+		return -1;
+	}
+	if (is_input(&st, &file)) {
+		fprintf(stderr, "sb_render: %s is the input file; the output has to "
+		        "go to another one\n", output);
+		close(fd);
+		close_chain(&chain);
+		close_input(&file);
+		return -1;
+	}
+	/* devices and pipes (/dev/null, /dev/stdout) can't be truncated */
+	if (S_ISREG(st.st_mode) && ftruncate(fd, 0) != 0) {
+		fprintf(stderr, "sb_render: %s: %s\n", output, strerror(errno));
+		close(fd);
+		close_chain(&chain);
+		close_input(&file);
+		return -1;
+	}
+	if (file.is_wav) {
+		/* leave room for the header; it's written once the length is
+		 * known */
+		if (lseek(fd, WAV_HEADER_SIZE, SEEK_SET) < 0) {
+			if (errno == ESPIPE)
+				fprintf(stderr, "sb_render: %s: the WAV header is written "
+				        "once the length is known, so WAV output has to go "
+				        "to a file that can be seeked\n", output);
+			else
+				fprintf(stderr, "sb_render: %s: %s\n", output,
+				        strerror(errno));
+			close(fd);
+			close_chain(&chain);
+			close_input(&file);
+			return -1;
+		}
+	}
+
+	if (start_writer(&writer, fd, (size_t)block * frame_size) != 0) {
+		fprintf(stderr, "sb_render: could not start the writer thread\n");
+		close(fd);
+		close_chain(&chain);
+		close_input(&file);
+		return -1;
+	}
+
+	while (written < file.frames) {
+		unsigned long frames = file.frames - written < block
+		                       ? file.frames - written : block;
+		unsigned char * out = writer_buffer(&writer);
+		unsigned long t = 0;
+
+		/* every tile goes through the whole chain before the next one is
+		 * read, so with a small tile the samples stay in the cache from
+		 * the first plugin to the last.  While there is latency left to
+		 * drop, a tile may be bigger than the room left in the block; what
+		 * is kept of it never is. */
+		while (t < frames) {
+			unsigned long n = frames - t + skip < tile ? frames - t + skip
+			                                           : tile;
+			unsigned long drop;
+			LADSPA_Data * result;
+
+			result = feed_chain(&chain, &file, fed, n, 0);
+			if (fed == 0)
+				skip = chain_latency(&chain);
+			fed += n;
+
+			drop = skip < n ? skip : n;
+			skip -= drop;
+			write_frames(out + (size_t)t * frame_size, result + drop,
+			             file.channels, 0, file.channels, n - drop, tile,
+			             format, options->dither ? dither : NULL);
+			t += n - drop;
+		}
+		written += frames;
+		release_input(&file, fed < file.frames ? fed : file.frames);
+
+		writer_submit(&writer, (size_t)frames * frame_size);
+	}
+
+	error = stop_writer(&writer);
+	if (!error && file.is_wav
+	    && write_wav_header(fd, file.channels, file.rate, file.frames,
+	                        format) != 0)
+		error = errno;
+	if (close(fd) != 0 && !error)
+		error = errno;
+	if (error)
+		fprintf(stderr, "sb_render: %s: %s\n", output, strerror(error));
+
+	close_chain(&chain);
+	close_input(&file);
+
+	return error ? -1 : 0;
+}
+
+/*****************************************************************************
+ * Splits "library.so[:label[:settings]]" into a plugin_spec.  The strings
+ * point into 'arg', which is modified.
+ *****************************************************************************/
+static void parse_plugin(char * arg, struct plugin_spec * spec)
+{
+	char * colon;
+
+	spec->path = arg;
+	spec->label = NULL;
+	spec->settings = NULL;
+
+	colon = strchr(arg, ':');
+	if (!colon)
+		return;
+	*colon = '\0';
+	spec->label = colon + 1;
+
+	colon = strchr(spec->label, ':');
+	if (colon) {
+		*colon = '\0';
+		spec->settings = colon + 1;
+	}
+	if (!*spec->label)
+		spec->label = NULL;
+}
+
+/*****************************************************************************
+ * BATCH MODE
+ *
+ * With -m, the files to render come from a manifest with one file per line:
+ *
+ *   input output [plugin.so[:label[:port=value,...]] ...]
+ *
+ * A line without any plugins uses the chain given with -p.  Blank lines and
+ * lines starting with '#' are skipped.
+ *
+ * Each file is split into jobs of as few channels as its chain allows (one
+ * channel per job when every plugin is mono), and every job gets plugin
+ * instances of its own.  The jobs are run by a pool of worker threads, each
+ * with a deque of jobs.  A worker takes jobs from the back of its own deque,
+ * and once that runs dry it steals from the front of the others.  All the
+ * jobs of one file start out in the same deque, so channels of one file
+ * mostly run on one worker while there are other files to keep the
+ * rest busy, and only get spread out when there aren't.
+ *
+ * Batch output files are created at their full size up front and mapped into
+ * memory, so that jobs for different channels of the same file can each
+ * write their samples straight into place.
+ *****************************************************************************/
+
+/* One line of the manifest. */
+struct batch_file {
+	char * line;                 /* the strings below point into this */
+	const char * input;
+	const char * output;
+	struct plugin_spec specs[MAX_PLUGINS];
+	int spec_count;
+	struct sound_file in;
+	unsigned char * out_map;
+	size_t out_size;
+	unsigned char * out_data;    /* first sample of the output */
+	dev_t out_dev;               /* which file the output is, so no */
+	ino_t out_ino;               /* later line can truncate it as well */
+	int out_format;              /* FORMAT_xxx */
+	int dither;
+	unsigned int group;          /* channels per job */
+};
+
+/* Some channels of one file. */
+struct job {
+	struct batch_file * file;
+	unsigned int channel;        /* first channel */
+	unsigned int count;          /* number of channels */
+	unsigned long seed;
+	int failed;
+};
+
+/* A worker's jobs.  The owner takes from the tail, thieves from the head. */
+struct deque {
+	pthread_mutex_t lock;
+	struct job ** jobs;
+	int head;
+	int tail;
+};
+
+struct pool {
+	struct deque * deques;
+	int workers;
+	unsigned long block;
+};
+
+struct worker {
+	struct pool * pool;
+	int id;
+	pthread_t thread;
+};
+
+/*****************************************************************************
+ * Returns the greatest common divisor of a and b.
+ *****************************************************************************/
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*****************************************************************************
+ * Works out the smallest number of channels a chain can be run on (the least
+ * common multiple of the channels each plugin takes).  That's how many
+ * channels go in each job.
+ *
+ * Returns 0 on success, -1 if a plugin can't be loaded.
+ *****************************************************************************/
+static int chain_group(const struct plugin_spec * specs, int spec_count,
+                       unsigned int * group)
+{
+	int s;
+
+	*group = 1;
+	for (s = 0; s < spec_count; ++s) {
+		LADSPA_Descriptor_Function function;
+		const LADSPA_Descriptor * d;
+		unsigned int inputs = 0;
+		unsigned long port;
+		void * library;
+
+		library = sb_host_open(specs[s].path, &function);
+		if (!library) {
+			fprintf(stderr, "sb_render: %s\n", sb_host_error());
+			return -1;
+		}
+		d = sb_host_find(function, specs[s].label);
+		if (!d) {
+			fprintf(stderr, "sb_render: %s: no plugin labelled '%s'\n",
+			        specs[s].path, specs[s].label ? specs[s].label : "");
+			dlclose(library);
+			return -1;
+		}
+		for (port = 0; port < d->PortCount; ++port)
+			if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[port])
+			    && LADSPA_IS_PORT_INPUT(d->PortDescriptors[port]))
+				++inputs;
+		dlclose(library);
+
+		/* open_chain() complains properly about plugins that don't fit */
+		if (inputs)
+			*group = *group / gcd(*group, inputs) * inputs;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * Maps the input of a manifest line.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int open_batch_input(struct batch_file * file,
+                            const struct io_options * options)
+{
+	if (open_input(file->input, &file->in, options) != 0)
+		return -1;
+	file->out_format = options->out_format >= 0 ? options->out_format
+	                                            : file->in.format;
+	file->dither = options->dither;
+	if (chain_group(file->specs, file->spec_count, &file->group) != 0)
+		return -1;
+	if (file->in.channels % file->group != 0) {
+		fprintf(stderr, "sb_render: %s: the plugins need a multiple of %u "
+		        "channels\n", file->input, file->group);
+		return -1;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ * Creates the output of a manifest line at full size.  Every input in the
+ * manifest ('files', 'count') has to be mapped already: the output is
+ * checked against all of them before it is truncated, since any line's
+ * output could be another line's input.  It is checked against the outputs
+ * of the lines before it too, which are already mapped: truncating one of
+ * those again would pull the pages out from under that mapping.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int open_batch_output(struct batch_file * file,
+                             const struct batch_file * files, int count)
+{
+	struct stat st;
+	size_t header;
+	int fd;
+	int error;
+	int f;
+
+	header = file->in.is_wav ? WAV_HEADER_SIZE : 0;
+	file->out_size = header + (size_t)file->in.frames * file->in.channels
+	                          * formats[file->out_format].bytes;
+
+	fd = open_output(file->output, O_RDWR, &st);
+	if (fd < 0)
+		return -1;
+	for (f = 0; f < count; ++f) {
+		if (is_input(&st, &files[f].in)) {
+			fprintf(stderr, "sb_render: %s is also an input (%s); the "
+			        "output has to go to another file\n", file->output,
+			        files[f].input);
+			close(fd);
+			return -1;
+		}
+	}
+	for (f = 0; &files[f] < file; ++f) {
+		if (st.st_dev == files[f].out_dev && st.st_ino == files[f].out_ino) {
+			fprintf(stderr, "sb_render: %s is also the output of %s; "
+			        "every line needs an output of its own\n", file->output,
+			        files[f].input);
+			close(fd);
+			return -1;
+		}
+	}
+	file->out_dev = st.st_dev;
+	file->out_ino = st.st_ino;
+	if (ftruncate(fd, 0) != 0) {
+		fprintf(stderr, "sb_render: %s: %s\n", file->output,
+		        strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* reserve the disk space now: running out of it halfway through a
+	 * mapped file would kill us with SIGBUS instead of an error */
+	error = file->out_size ? posix_fallocate(fd, 0, file->out_size) : 0;
+	if (!error && file->out_size) {
+		file->out_map = mmap(NULL, file->out_size, PROT_READ | PROT_WRITE,
+		                     MAP_SHARED, fd, 0);
+		if (file->out_map == MAP_FAILED) {
+			file->out_map = NULL;
+			error = errno;
+		}
+	}
+	close(fd);
+	if (error) {
+		fprintf(stderr, "sb_render: %s: %s\n", file->output,
+		        strerror(error));
+		return -1;
+	}
+
+	if (file->out_map) {
+		if (file->in.is_wav)
+			make_wav_header(file->out_map, file->in.channels,
+			                file->in.rate, file->in.frames, file->out_format);
+		file->out_data = file->out_map + header;
+	}
+	return 0;
+}
+
+static void close_batch_file(struct batch_file * file)
+{
+	if (file->out_map)
+		munmap(file->out_map, file->out_size);
+	file->out_map = NULL;
+	close_input(&file->in);
+}
+
+/*****************************************************************************
+ * Renders the channels of one job, reading straight from the mapped input
+ * and writing straight into the mapped output.
+ *
+ * Returns 0 on success, -1 on failure.
+ *****************************************************************************/
+static int run_job(struct job * job, unsigned long block)
+{
+	struct batch_file * file = job->file;
+	unsigned int channels = file->in.channels;
+	struct chain chain;
+	size_t frame_size = (size_t)channels * formats[file->out_format].bytes;
+	unsigned long written = 0;
+	unsigned long fed = 0;
+	unsigned long skip = 0;
+	uint32_t dither[MAX_CHANNELS];
+	unsigned int c;
+
+	if (open_chain(&chain, file->specs, file->spec_count, job->count,
+	               file->in.rate, block, job->seed) != 0)
+		return -1;
+	for (c = job->channel; c < job->channel + job->count; ++c)
+		dither[c] = dither_seed(c);
+
+	/* the same latency compensation as render_file(), but the output is
+	 * mapped, so whatever is kept goes straight into place */
+	while (written < file->in.frames) {
+		unsigned long n = file->in.frames - written + skip < block
+		                  ? file->in.frames - written + skip : block;
+		unsigned long drop;
+		LADSPA_Data * result;
+
+		result = feed_chain(&chain, &file->in, fed, n, job->channel);
+		if (fed == 0)
+			skip = chain_latency(&chain);
+		fed += n;
+
+		drop = skip < n ? skip : n;
+		skip -= drop;
+		write_frames(file->out_data + (size_t)written * frame_size,
+		             result + drop, channels, job->channel, job->count,
+		             n - drop, block, file->out_format,
+		             file->dither ? dither : NULL);
+		written += n - drop;
+	}
+
+	close_chain(&chain);
+	return 0;
+}
+
+/*****************************************************************************
+ * Takes the newest job from a worker's own deque.
+ *****************************************************************************/
+static struct job * pop_job(struct deque * q)
+{
+	struct job * job = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail > q->head)
+		job = q->jobs[--q->tail];
+	pthread_mutex_unlock(&q->lock);
+
+	return job;
+}
+
+/*****************************************************************************
+ * Takes the oldest job from another worker's deque.
+ *****************************************************************************/
+static struct job * steal_job(struct deque * q)
+{
+	struct job * job = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail > q->head)
+		job = q->jobs[q->head++];
+	pthread_mutex_unlock(&q->lock);
+
+	return job;
+}
+
+/*****************************************************************************
+ * A worker thread: runs jobs until there are none left anywhere.  No new
+ * jobs are ever added once the pool starts, so when every deque is empty
+ * the work is done.
+ *****************************************************************************/
+static void * worker_thread(void * arg)
+{
+	struct worker * w = arg;
+	struct pool * pool = w->pool;
+
+	for (;;) {
+		struct job * job = pop_job(&pool->deques[w->id]);
+		int k;
+
+		for (k = 1; !job && k < pool->workers; ++k)
+			job = steal_job(&pool->deques[(w->id + k) % pool->workers]);
+		if (!job)
+			break;
+
+		if (run_job(job, pool->block) != 0)
+			job->failed = 1;
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+ * Reads the manifest into 'files'.  Lines without plugins get a copy of
+ * 'specs'.
+ *
+ * Returns the number of files, or -1 on failure.
+ *****************************************************************************/
+static int read_manifest(const char * path, struct batch_file ** files,
+                         const struct plugin_spec * specs, int spec_count)
+{
+	FILE * f;
+	char * line = NULL;
+	size_t size = 0;
+	int count = 0;
+	int capacity = 0;
+	int number = 0;
+
+	f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "sb_render: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	*files = NULL;
+	while (getline(&line, &size, f) >= 0) {
+		struct batch_file * file;
+		char * save;
+		char * token;
+		char * copy;
+
+		++number;
+		token = line + strspn(line, " \t\r\n");
+		if (*token == '\0' || *token == '#')
+			continue;
+
+		if (count == capacity) {
+			struct batch_file * bigger;
+
+			capacity = capacity ? capacity * 2 : 16;
+			bigger = realloc(*files, capacity * sizeof(**files));
+			if (!bigger)
+				goto oom;
+			*files = bigger;
+		}
+		copy = strdup(token);
+		if (!copy)
+			goto oom;
+
+		file = &(*files)[count++];
+		memset(file, 0, sizeof(*file));
+		file->line = copy;
+		file->input = strtok_r(copy, " \t\r\n", &save);
+		file->output = strtok_r(NULL, " \t\r\n", &save);
+		if (!file->output) {
+			fprintf(stderr, "sb_render: %s:%d: expected an input and an "
+			        "output file\n", path, number);
+			goto fail;
+		}
+
+		while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+			if (file->spec_count == MAX_PLUGINS) {
+				fprintf(stderr, "sb_render: %s:%d: at most %d plugins\n",
+				        path, number, MAX_PLUGINS);
+				goto fail;
+			}
+			parse_plugin(token, &file->specs[file->spec_count++]);
+		}
+		if (file->spec_count == 0) {
+			if (spec_count == 0) {
+				fprintf(stderr, "sb_render: %s:%d: no plugins given\n",
+				        path, number);
+				goto fail;
+			}
+			memcpy(file->specs, specs, spec_count * sizeof(*specs));
+			file->spec_count = spec_count;
+		}
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return count;
+
+oom:
+	fprintf(stderr, "sb_render: out of memory\n");
+fail:
+	while (count > 0)
+		free((*files)[--count].line);
+	free(*files);
+	*files = NULL;
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return -1;
+}
+
+/*****************************************************************************
+ * Renders every file in the manifest with a pool of 'threads' workers.
+ * 'seed' (if not 0) seeds channel c of manifest line n with
+ * seed + n * MAX_CHANNELS + c.
+ *
+ * Returns 0 if every file rendered, -1 otherwise.
+ *****************************************************************************/
+static int render_batch(const char * manifest,
+                        const struct plugin_spec * specs, int spec_count,
+                        unsigned long block, const struct io_options * options,
+                        unsigned long seed, int threads)
+{
+	struct batch_file * files;
+	struct job * jobs = NULL;
+	struct deque * deques = NULL;
+	struct worker * workers = NULL;
+	struct pool pool;
+	int file_count;
+	int job_count = 0;
+	int started = 0;
+	int failed = 0;
+	int f;
+	int j;
+	int w;
+
+	file_count = read_manifest(manifest, &files, specs, spec_count);
+	if (file_count < 0)
+		return -1;
+
+	/* all the inputs are mapped before any output is created, so that no
+	 * output can truncate an input that is still to be checked */
+	for (f = 0; f < file_count; ++f) {
+		if (open_batch_input(&files[f], options) != 0) {
+			failed = 1;
+			goto done;
+		}
+		job_count += files[f].in.channels / files[f].group;
+	}
+	for (f = 0; f < file_count; ++f) {
+		if (check_seed(seed, seed + (unsigned long)f * MAX_CHANNELS
+		                     + files[f].in.channels - 1) != 0) {
+			failed = 1;
+			goto done;
+		}
+	}
+	for (f = 0; f < file_count; ++f) {
+		if (open_batch_output(&files[f], files, file_count) != 0) {
+			failed = 1;
+			goto done;
+		}
+	}
+
+	jobs = calloc(job_count ? job_count : 1, sizeof(*jobs));
+	deques = calloc(threads, sizeof(*deques));
+	workers = calloc(threads, sizeof(*workers));
+	if (!jobs || !deques || !workers) {
+		fprintf(stderr, "sb_render: out of memory\n");
+		failed = 1;
+		goto done;
+	}
+
+	for (w = 0; w < threads; ++w) {
+		pthread_mutex_init(&deques[w].lock, NULL);
+		deques[w].jobs = calloc(job_count ? job_count : 1,
+		                        sizeof(struct job *));
+		if (!deques[w].jobs) {
+			fprintf(stderr, "sb_render: out of memory\n");
+			failed = 1;
+			goto done;
+		}
+	}
+
+	/* all the jobs of a file go into the same deque, and the files are
+	 * dealt out to the workers in turn; the first file is at the tail, so
+	 * each worker starts on the first of its files */
+	j = 0;
+	for (f = 0; f < file_count; ++f) {
+		struct batch_file * file = &files[f];
+		unsigned int c;
+
+		for (c = 0; c < file->in.channels; c += file->group) {
+			jobs[j].file = file;
+			jobs[j].channel = c;
+			jobs[j].count = file->group;
+			jobs[j].seed = seed ? seed + (unsigned long)f * MAX_CHANNELS + c
+			                    : 0;
+			++j;
+		}
+	}
+	for (j = job_count - 1; j >= 0; --j) {
+		struct deque * q = &deques[(jobs[j].file - files) % threads];
+		q->jobs[q->tail++] = &jobs[j];
+	}
+
+	pool.deques = deques;
+	pool.workers = threads;
+	pool.block = block;
+	for (w = 0; w < threads; ++w) {
+		workers[w].pool = &pool;
+		workers[w].id = w;
+		if (pthread_create(&workers[w].thread, NULL, worker_thread,
+		                   &workers[w]) != 0) {
+			fprintf(stderr, "sb_render: could not start a worker thread\n");
+			failed = 1;
+			break;
+		}
+		++started;
+	}
+	/* if some workers didn't start, the ones that did steal their jobs */
+	for (w = 0; w < started; ++w)
+		pthread_join(workers[w].thread, NULL);
+	if (started == 0)
+		goto done;
+
+	for (j = 0; j < job_count; ++j) {
+		if (jobs[j].failed) {
+			fprintf(stderr, "sb_render: %s: channel %u failed\n",
+			        jobs[j].file->input, jobs[j].channel + 1);
+			failed = 1;
+		}
+	}
+
+done:
+	for (f = 0; f < file_count; ++f) {
+		close_batch_file(&files[f]);
+		free(files[f].line);
+	}
+	free(files);
+	if (deques) {
+		for (w = 0; w < threads; ++w) {
+			if (deques[w].jobs)
+				pthread_mutex_destroy(&deques[w].lock);
+			free(deques[w].jobs);
+		}
+	}
+	free(deques);
+	free(workers);
+	free(jobs);
+
+	return failed ? -1 : 0;
+}
+
+/*****************************************************************************
+ * Returns the FORMAT_xxx called 'name', or -1 if there isn't one.
+ *****************************************************************************/
+static int find_format(const char * name)
+{
+	int f;
+
+	for (f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); ++f)
+		if (strcmp(name, formats[f].name) == 0)
+			return f;
+	return -1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sb_render [-b frames] [-t frames] [-r rate] "
+	        "[-c channels]\n"
+	        "                 [-e format] [-f format] [-D] [-s seed]\n"
+	        "                 -p plugin.so[:label[:port=value,...]] "
+	        "[-p ...]\n"
+	        "                 input output\n"
+	        "       sb_render [-b frames] [-t frames] [-r rate] "
+	        "[-c channels]\n"
+	        "                 [-e format] [-f format] [-D] [-s seed] "
+	        "[-j threads]\n"
+	        "                 [-p ...] -m manifest\n"
+	        "formats: pcm16 pcm24 pcm32 float double\n"
+	        "seeds: every seed worked out from -s (one per channel, and 64 "
+	        "more per\n"
+	        "       manifest line) has to be at most 16777216\n");
+	exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+	struct plugin_spec specs[MAX_PLUGINS];
+	int spec_count = 0;
+	unsigned long block = DEFAULT_BLOCK;
+	unsigned long tile = 0;
+	struct io_options options = { 0, 0, FORMAT_FLOAT, -1, 1 };
+	unsigned long seed = 0;
+	const char * manifest = NULL;
+	long threads = 0;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-D") == 0) {
+			options.dither = 0;
+			continue;
+		}
+		if (i + 1 >= argc)
+			usage();
+		if (strcmp(argv[i], "-b") == 0) {
+			block = strtoul(argv[++i], NULL, 10);
+			if (block == 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-t") == 0) {
+			tile = strtoul(argv[++i], NULL, 10);
+			if (tile == 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-r") == 0) {
+			options.raw_rate = strtoul(argv[++i], NULL, 10);
+			if (options.raw_rate == 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-c") == 0) {
+			options.raw_channels = strtoul(argv[++i], NULL, 10);
+			if (options.raw_channels == 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-e") == 0) {
+			options.raw_format = find_format(argv[++i]);
+			if (options.raw_format < 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-f") == 0) {
+			options.out_format = find_format(argv[++i]);
+			if (options.out_format < 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-s") == 0) {
+			seed = strtoul(argv[++i], NULL, 10);
+			/* this also keeps the seeds worked out from it from
+			 * wrapping around */
+			if (seed > MAX_SEED)
+				usage();
+		}
+		else if (strcmp(argv[i], "-j") == 0) {
+			threads = strtol(argv[++i], NULL, 10);
+			if (threads <= 0)
+				usage();
+		}
+		else if (strcmp(argv[i], "-m") == 0) {
+			manifest = argv[++i];
+		}
+		else if (strcmp(argv[i], "-p") == 0) {
+			if (spec_count == MAX_PLUGINS) {
+				fprintf(stderr, "sb_render: at most %d plugins\n",
+				        MAX_PLUGINS);
+				return 1;
+			}
+			parse_plugin(argv[++i], &specs[spec_count++]);
+		}
+		else
+			usage();
+	}
+
+	if (tile == 0 || tile > block)
+		tile = block;
+
+	if (manifest) {
+		if (i != argc)
+			usage();
+		if (threads == 0)
+			threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads <= 0)
+			threads = 1;
+		/* batch jobs write straight into the mapped output, so there is no
+		 * I/O block to speak of and the chain just runs a tile at a time */
+		return render_batch(manifest, specs, spec_count, tile, &options,
+		                    seed, (int)threads) == 0 ? 0 : 1;
+	}
+
+	if (argc - i != 2 || spec_count == 0)
+		usage();
+
+	return render_file(argv[i], argv[i + 1], specs, spec_count, block, tile,
+	                   &options, seed) == 0 ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+/* sb_reverse.c
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Reverse-copy and reverse-in-place kernels (see sb_reverse.h).
+ *
+ * Every vector kernel works the same way: load a whole register of samples
+ * from the far end of the source, flip the order of the lanes inside the
+ * register, and store it at the near end of the destination.  Whatever is
+ * left over (less than one register) is done one sample at a time.  The
+ * loads and stores are unaligned, since sub-blocks start wherever the random
+ * cut happened to land.
+ */
+
+#include <pthread.h>
+
+#include "sb_isa.h"
+#include "sb_reverse.h"
+
+#if defined(SB_ISA_X86)
+#define SB_REVERSE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(SB_ISA_ARM_NEON)
+#define SB_REVERSE_NEON
+#include <arm_neon.h>
+#endif
+
+static void resolve_copy(LADSPA_Data * dst, const LADSPA_Data * src,
+                         unsigned long count);
+static void resolve_in_place(LADSPA_Data * buffer, unsigned long count);
+
+void (*sb_reverse_copy)(LADSPA_Data *, const LADSPA_Data *, unsigned long)
+	= resolve_copy;
+void (*sb_reverse_in_place)(LADSPA_Data *, unsigned long) = resolve_in_place;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static const char * kernel_name = "c";
+
+/*****************************************************************************
+ * Plain C kernels.  These are also used for the left-over samples of the
+ * vector kernels.
+ *****************************************************************************/
+static void copy_c(LADSPA_Data * dst, const LADSPA_Data * src,
+                   unsigned long count)
+{
+	unsigned long i;
+
+	for (i = 0; i < count; ++i)
+		dst[i] = src[count - 1 - i];
+}
+
+static void in_place_c(LADSPA_Data * buffer, unsigned long count)
+{
+	unsigned long i = 0;
+	unsigned long j = count;
+	LADSPA_Data temp;
+
+	while (j > i + 1) {
+		--j;
+		temp = buffer[i];
+		buffer[i] = buffer[j];
+		buffer[j] = temp;
+		++i;
+	}
+}
+
+#ifdef SB_REVERSE_X86
+/*****************************************************************************
+ * SSE2 kernels, 4 samples per register.
+ *****************************************************************************/
+__attribute__((target("sse2")))
+static void copy_sse2(LADSPA_Data * dst, const LADSPA_Data * src,
+                      unsigned long count)
+{
+	unsigned long i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 v = _mm_loadu_ps(src + count - i - 4);
+		_mm_storeu_ps(dst + i, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+	copy_c(dst + i, src, count - i);
+}
+
+__attribute__((target("sse2")))
+static void in_place_sse2(LADSPA_Data * buffer, unsigned long count)
+{
+	unsigned long i = 0;
+	unsigned long j = count;
+
+	/* swap a register from the front with a register from the back until
+	 * they would meet in the middle */
+	while (j >= i + 8) {
+		__m128 front = _mm_loadu_ps(buffer + i);
+		__m128 back = _mm_loadu_ps(buffer + j - 4);
+		_mm_storeu_ps(buffer + i,
+		              _mm_shuffle_ps(back, back, _MM_SHUFFLE(0, 1, 2, 3)));
+		_mm_storeu_ps(buffer + j - 4,
+		              _mm_shuffle_ps(front, front, _MM_SHUFFLE(0, 1, 2, 3)));
+		i += 4;
+		j -= 4;
+	}
+	in_place_c(buffer + i, j - i);
+}
+
+/*****************************************************************************
+ * AVX2 kernels, 8 samples per register.  A lane permute is needed since the
+ * plain AVX shuffles only work within each 128-bit half.
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static void copy_avx2(LADSPA_Data * dst, const LADSPA_Data * src,
+                      unsigned long count)
+{
+	const __m256i flip = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	unsigned long i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 v = _mm256_loadu_ps(src + count - i - 8);
+		_mm256_storeu_ps(dst + i, _mm256_permutevar8x32_ps(v, flip));
+	}
+	copy_sse2(dst + i, src, count - i);
+}
+
+__attribute__((target("avx2")))
+static void in_place_avx2(LADSPA_Data * buffer, unsigned long count)
+{
+	const __m256i flip = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	unsigned long i = 0;
+	unsigned long j = count;
+
+	while (j >= i + 16) {
+		__m256 front = _mm256_loadu_ps(buffer + i);
+		__m256 back = _mm256_loadu_ps(buffer + j - 8);
+		_mm256_storeu_ps(buffer + i, _mm256_permutevar8x32_ps(back, flip));
+		_mm256_storeu_ps(buffer + j - 8, _mm256_permutevar8x32_ps(front, flip));
+		i += 8;
+		j -= 8;
+	}
+	in_place_sse2(buffer + i, j - i);
+}
+
+/*****************************************************************************
+ * AVX-512 kernels, 16 samples per register, flipped with one permute.
+ *****************************************************************************/
+__attribute__((target("avx512f")))
+static void copy_avx512(LADSPA_Data * dst, const LADSPA_Data * src,
+                        unsigned long count)
+{
+	const __m512i flip = _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+	                                      8, 9, 10, 11, 12, 13, 14, 15);
+	unsigned long i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m512 v = _mm512_loadu_ps(src + count - i - 16);
+		_mm512_storeu_ps(dst + i, _mm512_permutexvar_ps(flip, v));
+	}
+	copy_avx2(dst + i, src, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void in_place_avx512(LADSPA_Data * buffer, unsigned long count)
+{
+	const __m512i flip = _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+	                                      8, 9, 10, 11, 12, 13, 14, 15);
+	unsigned long i = 0;
+	unsigned long j = count;
+
+	while (j >= i + 32) {
+		__m512 front = _mm512_loadu_ps(buffer + i);
+		__m512 back = _mm512_loadu_ps(buffer + j - 16);
+		_mm512_storeu_ps(buffer + i, _mm512_permutexvar_ps(flip, back));
+		_mm512_storeu_ps(buffer + j - 16, _mm512_permutexvar_ps(flip, front));
+		i += 16;
+		j -= 16;
+	}
+	in_place_avx2(buffer + i, j - i);
+}
+#endif
+
+#ifdef SB_REVERSE_NEON
+/*****************************************************************************
+ * NEON kernels, 4 samples per register: vrev64 swaps the samples within each
+ * half, and vext swaps the two halves.
+ *****************************************************************************/
+static inline float32x4_t flip_neon(float32x4_t v)
+{
+	v = vrev64q_f32(v);
+	return vextq_f32(v, v, 2);
+}
+
+static void copy_neon(LADSPA_Data * dst, const LADSPA_Data * src,
+                      unsigned long count)
+{
+	unsigned long i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(dst + i, flip_neon(vld1q_f32(src + count - i - 4)));
+	copy_c(dst + i, src, count - i);
+}
+
+static void in_place_neon(LADSPA_Data * buffer, unsigned long count)
+{
+	unsigned long i = 0;
+	unsigned long j = count;
+
+	while (j >= i + 8) {
+		float32x4_t front = vld1q_f32(buffer + i);
+		float32x4_t back = vld1q_f32(buffer + j - 4);
+		vst1q_f32(buffer + i, flip_neon(back));
+		vst1q_f32(buffer + j - 4, flip_neon(front));
+		i += 4;
+		j -= 4;
+	}
+	in_place_c(buffer + i, j - i);
+}
+#endif
+
+/*****************************************************************************
+ * Picks the best kernels for the CPU we are running on (see sb_isa.h).  This
+ * only ever runs once, from sb_reverse_init().
+ *****************************************************************************/
+static void pick(void)
+{
+	void (*copy)(LADSPA_Data *, const LADSPA_Data *, unsigned long) = copy_c;
+	void (*in_place)(LADSPA_Data *, unsigned long) = in_place_c;
+	int isa = sb_isa();
+
+#if defined(SB_REVERSE_X86)
+	if (isa >= SB_ISA_AVX512) {
+		copy = copy_avx512;
+		in_place = in_place_avx512;
+	}
+	else if (isa >= SB_ISA_AVX2) {
+		copy = copy_avx2;
+		in_place = in_place_avx2;
+	}
+	else if (isa >= SB_ISA_SSE2) {
+		copy = copy_sse2;
+		in_place = in_place_sse2;
+	}
+	else {
+		isa = SB_ISA_C;
+	}
+#elif defined(SB_REVERSE_NEON)
+	if (isa == SB_ISA_NEON) {
+		copy = copy_neon;
+		in_place = in_place_neon;
+	}
+#else
+	isa = SB_ISA_C;
+#endif
+
+	kernel_name = sb_isa_name(isa);
+	sb_reverse_copy = copy;
+	sb_reverse_in_place = in_place;
+}
+
+void sb_reverse_init(void)
+{
+	pthread_once(&once, pick);
+}
+
+const char * sb_reverse_kernel_name(void)
+{
+	sb_reverse_init();
+	return kernel_name;
+}
+
+/*****************************************************************************
+ * The function pointers start out pointing at these, so a plugin that never
+ * calls sb_reverse_init() still ends up with the right kernel.
+ *****************************************************************************/
+static void resolve_copy(LADSPA_Data * dst, const LADSPA_Data * src,
+                         unsigned long count)
+{
+	sb_reverse_init();
+	sb_reverse_copy(dst, src, count);
+}
+
+static void resolve_in_place(LADSPA_Data * buffer, unsigned long count)
+{
+	sb_reverse_init();
+	sb_reverse_in_place(buffer, count);
+}
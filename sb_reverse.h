@@ -0,0 +1,42 @@
+/* sb_reverse.h
+ *
+ * Copyright © 2009 Tyler Hayes
+ * ALL RIGHTS RESERVED
+ *
+ * [This program is licensed under the GPL version 3 or later.]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ *
+ * Reverse-copy and reverse-in-place kernels for buffers of LADSPA_Data,
+ * shared by esreveR and Kite.  Link sb_reverse.o and sb_isa.o into the plugin
+ * the same way xorgens.o is.
+ *
+ * sb_reverse_init() picks the fastest kernel the CPU supports (AVX-512, AVX2
+ * or SSE2 on x86, NEON on ARM, plain C everywhere else; see sb_isa.h), once
+ * per process.  Plugins call it from instantiate(), before any run() can use
+ * the function pointers from another thread; a single-threaded caller that
+ * skips it still gets the right kernel on the first call.
+ */
+
+#ifndef SB_REVERSE_H
+#define SB_REVERSE_H
+
+#include "ladspa.h"
+
+/* Picks the kernels for this CPU.  Safe to call more than once, and from
+ * several threads at the same time. */
+void sb_reverse_init(void);
+
+/* Copies 'count' samples from 'src' to 'dst' in reverse order, so that
+ * dst[0] = src[count - 1], dst[1] = src[count - 2], and so on.  The two
+ * buffers must not overlap. */
+extern void (*sb_reverse_copy)(LADSPA_Data * dst, const LADSPA_Data * src,
+                               unsigned long count);
+
+/* Reverses the order of the first 'count' samples of 'buffer'. */
+extern void (*sb_reverse_in_place)(LADSPA_Data * buffer, unsigned long count);
+
+/* Name of the selected kernel ("avx512", "avx2", "sse2", "neon" or "c"). */
+const char * sb_reverse_kernel_name(void);
+
+#endif
@@ -0,0 +1,30 @@
+#!/bin/sh
+# tests/arena.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Stress test for sb_arena.c, run by 'make check'.  'sb_check arena' has
+# several threads allocate and release buffers at random, and fails if one
+# is misaligned, not zeroed, or overlaps another.  That goes through the
+# pool's free list (splitting and merging chunks), the mappings of their own
+# that big buffers get, and whichever of huge pages or the fallback to
+# ordinary pages this machine gives us.  It is run once more with SB_MLOCK
+# set, where mlock() may fail (a small RLIMIT_MEMLOCK) without any harm.
+
+failed=0
+
+for mlock in 0 1; do
+	if SB_MLOCK=$mlock ./sb_check arena; then
+		echo "PASS: SB_MLOCK=$mlock"
+	else
+		echo "FAIL: SB_MLOCK=$mlock"
+		failed=1
+	fi
+done
+
+exit $failed
@@ -0,0 +1,22 @@
+#!/bin/sh
+# tests/control.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Checks sb_control.h, run by 'make check': an unchanged port is reported
+# as unchanged and stays flat, a ramp lands exactly on the new value on the
+# last sample of its block (for many values and block sizes) and the next
+# block is flat again, and a block of no samples jumps straight to the new
+# value without dividing by zero.
+
+if ./sb_check control; then
+	echo "PASS: sb_control.h"
+	exit 0
+fi
+echo "FAIL: sb_control.h"
+exit 1
@@ -0,0 +1,23 @@
+#!/bin/sh
+# tests/gate.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Checks sb_denormal.h, run by 'make check': sb_is_silent() on minus zero
+# and on single samples of sound anywhere in a block (including the samples
+# after the last group of 16), the open -> closing -> closed sequence of
+# sb_gate with no tail and with one that isn't a whole number of blocks,
+# the gate opening again on sound, and that sb_denormals_restore() puts
+# MXCSR back exactly as it was.
+
+if ./sb_check gate; then
+	echo "PASS: sb_denormal.h"
+	exit 0
+fi
+echo "FAIL: sb_denormal.h"
+exit 1
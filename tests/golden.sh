@@ -0,0 +1,83 @@
+#!/bin/sh
+# tests/golden.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Golden output test, run by 'make check'.  The same seeded noise file goes
+# through every plugin in SB_PLUGINS with its default settings (and a fixed
+# seed for plugins that have a seed port), and each result is compared with
+# the stored one in tests/golden/<label>.wav, sample by sample, within
+# SB_TOLERANCE (default 1e-5, about -100 dB, which leaves room for a
+# different compiler or -O level but not for a change in the sound).
+#
+# 'make update-golden' (SB_UPDATE=1) writes the golden files instead.  Only
+# do that after listening to the new output, and commit them with the change
+# that made them different.
+
+: ${srcdir:=.}
+: ${SB_PLUGINS:="ADT/sb_adt.so esreveR/sb_esreveR.so Kite/sb_kite.so Revolution/sb_revolution.so Ringer/sb_ringer.so"}
+: ${SB_TOLERANCE:=1e-5}
+
+golden="$srcdir/tests/golden"
+work="golden.tmp"
+checked=0
+failed=0
+
+rm -rf "$work" && mkdir "$work" || exit 99
+# 2 seconds of stereo noise at 44.1 kHz, and 4 channels for plugins with
+# more inputs
+./sb_check noise "$work/in2.wav" 88200 2 44100 4242 || exit 99
+
+for plugin in $SB_PLUGINS; do
+	if [ ! -f "$plugin" ]; then
+		echo "golden: $plugin not built, skipping it"
+		continue
+	fi
+	./sb_check labels "$plugin" > "$work/labels" || exit 99
+	while read label inputs; do
+		if [ "$inputs" -eq 0 ]; then
+			echo "golden: $label has no audio inputs, skipping it"
+			continue
+		elif [ "$inputs" -le 2 ]; then
+			input="$work/in2.wav"
+		else
+			input="$work/in$inputs.wav"
+			[ -f "$input" ] || ./sb_check noise "$input" 88200 "$inputs" \
+			                   44100 4242 || exit 99
+		fi
+		output="$work/$label.wav"
+
+		if ! ./sb_render -s 1 -p "$plugin:$label" "$input" "$output"; then
+			echo "FAIL: $label: sb_render failed"
+			failed=$((failed + 1))
+			continue
+		fi
+
+		if [ -n "$SB_UPDATE" ]; then
+			mkdir -p "$golden" && cp "$output" "$golden/$label.wav" || exit 99
+			echo "golden: wrote $golden/$label.wav"
+		elif [ ! -f "$golden/$label.wav" ]; then
+			echo "golden: no $golden/$label.wav yet ('make update-golden')"
+			continue
+		elif ./sb_check compare "$golden/$label.wav" "$output" \
+		                        "$SB_TOLERANCE"; then
+			echo "PASS: $label"
+		else
+			echo "FAIL: $label"
+			failed=$((failed + 1))
+		fi
+		checked=$((checked + 1))
+	done < "$work/labels"
+done
+
+rm -rf "$work"
+
+[ $failed -eq 0 ] || exit 1
+# 77 tells automake the test was skipped rather than passed
+[ $checked -gt 0 ] || exit 77
+exit 0
@@ -0,0 +1,44 @@
+#!/bin/sh
+# tests/profile.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Checks the run() timing histogram of sb_profile.h, run by 'make check'.
+# 'sb_check profile' makes up 1000 run() calls of 1, 2, ... 1000 ns per
+# sample, so the report has to say calls=1000, a p50 near 500, a p99 near
+# 990 and a max of at least 1000.  With 4 buckets per power of two, a bucket
+# is at most 25% wide, which is the slack the percentiles get here.
+
+report="profile.tmp"
+
+rm -f "$report"
+SB_PROFILE="$report" ./sb_check profile || exit 99
+[ -f "$report" ] || { echo "FAIL: sb_check profile didn't report"; exit 1; }
+
+awk '
+	{
+		for (i = 1; i <= NF; ++i) {
+			split($i, kv, "=")
+			value[kv[1]] = kv[2] + 0
+		}
+		++lines
+	}
+	END {
+		failed = lines != 1 || value["calls"] != 1000 \
+		         || value["p50"] < 500 / 1.25 || value["p50"] > 500 * 1.25 \
+		         || value["p99"] < 990 / 1.25 || value["p99"] > 990 * 1.25 \
+		         || value["max"] < 1000
+		printf "%s: calls=%d p50=%.3f p99=%.3f max=%.3f\n",
+		       failed ? "FAIL" : "PASS", value["calls"], value["p50"],
+		       value["p99"], value["max"]
+		exit failed
+	}
+' "$report"
+status=$?
+rm -f "$report"
+exit $status
@@ -0,0 +1,30 @@
+#!/bin/sh
+# tests/reverse.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Checks the reverse-copy and reverse-in-place kernels of sb_reverse.h
+# (shared by esreveR and Kite), run by 'make check'.  'sb_check reverse' is
+# run with SB_ISA capped at each instruction set in turn, so every kernel
+# this CPU can run is compared with the plain C loop.  SB_ISA can't go past
+# what the CPU has, so on an older machine the higher levels just test the
+# best kernel it has again; the kernel each run ended up with is printed.
+
+failed=0
+
+for isa in c sse2 avx2 avx512 neon; do
+	kernel=`SB_ISA=$isa ./sb_check reverse`
+	if [ $? -ne 0 ]; then
+		echo "FAIL: SB_ISA=$isa"
+		failed=1
+	else
+		echo "PASS: SB_ISA=$isa ($kernel kernels)"
+	fi
+done
+
+exit $failed
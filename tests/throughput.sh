@@ -0,0 +1,90 @@
+#!/bin/sh
+# tests/throughput.sh
+#
+# Copyright © 2009 Tyler Hayes
+# ALL RIGHTS RESERVED
+#
+# [This program is licensed under the GPL version 3 or later.]
+# Please see the file COPYING in the source
+# distribution of this software for license terms.
+#
+# Throughput gate, run by 'make check'.  Every plugin in SB_PLUGINS is timed
+# with sb_bench at a few typical host settings, and the test fails if any
+# of them now takes more than SB_SLOWDOWN percent (default 20) longer per
+# sample than it did in the stored baseline, tests/baseline.tsv.  Because the
+# run() calls are done under 'sb_bench -R', it also fails if a plugin has
+# started allocating memory inside run().
+#
+# Timings only mean something on the machine they were taken on, so the
+# baseline isn't shipped: make one with 'make update-baseline' (SB_UPDATE=1)
+# on an idle machine before starting on an optimization, and compare against
+# it after.  Without a baseline only the allocation check is done.
+
+: ${srcdir:=.}
+: ${SB_PLUGINS:="ADT/sb_adt.so esreveR/sb_esreveR.so Kite/sb_kite.so Revolution/sb_revolution.so Ringer/sb_ringer.so"}
+: ${SB_SLOWDOWN:=20}
+: ${SB_BENCH_FLAGS:="-r 44100,48000 -b 128:512 -s 2"}
+
+baseline="$srcdir/tests/baseline.tsv"
+current="throughput.tmp"
+plugins=
+
+for plugin in $SB_PLUGINS; do
+	if [ -f "$plugin" ]; then
+		plugins="$plugins $plugin"
+	else
+		echo "throughput: $plugin not built, skipping it"
+	fi
+done
+[ -n "$plugins" ] || exit 77
+
+./sb_bench -R $SB_BENCH_FLAGS $plugins > "$current"
+status=$?
+if [ $status -ne 0 ]; then
+	echo "FAIL: sb_bench exited with $status"
+	rm -f "$current"
+	exit 1
+fi
+
+if [ -n "$SB_UPDATE" ]; then
+	cp "$current" "$baseline" || exit 99
+	rm -f "$current"
+	echo "throughput: wrote $baseline"
+	exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+	rm -f "$current"
+	echo "PASS: no memory allocated in run()"
+	echo "throughput: no $baseline yet ('make update-baseline'), so the" \
+	     "timings weren't compared"
+	exit 0
+fi
+
+# rows are matched on label, mode, rate and block; ns/sample is column 8
+awk -F '\t' -v slowdown="$SB_SLOWDOWN" '
+	/^#/ { next }
+	NR == FNR { base[$2 FS $4 FS $5 FS $6] = $8; next }
+	{
+		key = $2 FS $4 FS $5 FS $6
+		if (!(key in base))
+			next
+		limit = base[key] * (1 + slowdown / 100)
+		change = ($8 / base[key] - 1) * 100
+		if ($8 > limit) {
+			printf "FAIL: %s %s %s Hz block %s: %.3f ns/sample, was %.3f " \
+			       "(%+.1f%%)\n", $2, $4, $5, $6, $8, base[key], change
+			failed = 1
+		}
+		++compared
+	}
+	END {
+		if (!failed)
+			printf "PASS: %d measurements within %s%% of the baseline\n",
+			       compared, slowdown
+		exit failed ? 1 : (compared ? 0 : 77)
+	}
+' "$baseline" "$current"
+status=$?
+rm -f "$current"
+exit $status